@@ -56,19 +56,10 @@ def print_vg(vg_name):
 
 #Returns the name of a vg with space available
 def find_vg_with_free_space():
-    free_space = 0
-    rc = None
-
-    vg_names = lvm.listVgNames()
-    for v in vg_names:
-        vg = lvm.vgOpen(v, 'r')
-        c_free = vg.getFreeSize()
-        if c_free > free_space:
-            free_space = c_free
-            rc = v
-        vg.close()
-
-    return rc
+    top = lvm.topVgsByFree(1)
+    if top and top[0][1] > 0:
+        return top[0][0]
+    return None
 
 #Walk through the volume groups and fine one with space in which we can
 #create a new logical volume
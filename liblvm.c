@@ -22,14 +22,73 @@
  */
 
 #include <Python.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/netlink.h>
+#include <libdevmapper.h>
 #include "lvm2app.h"
 
+/* lv.ioStats() needs stats histograms and region aux data (LVM 2.02.146) */
+#ifndef DM_STATS_REGIONS_ALL
+#error "libdevmapper from LVM 2.02.146 or later is required"
+#endif
+
 static lvm_t libh;
 
+/*
+ * lvm2app is not thread safe; everything that goes through the command
+ * context behind libh (opening, writing and closing VGs, scanning, error
+ * state, device-mapper queries) is serialized on liblvm_lock.  Each VG
+ * object has its own lock protecting its handle, so a close() in one thread
+ * can't pull the VG out from under another.  Lock order is VG, then library.
+ *
+ * That includes the side handles used for lockless and timed opens: lvm2
+ * keeps process-wide state (lvmcache, the device cache, logging) that all
+ * handles share, so reads of different VGs still take turns inside
+ * lvm2app.  Threads only overlap with Python work and with waits done
+ * outside the library.
+ *
+ * The library lock nests, since building a result may drop the last
+ * reference to some other VG object and close it.  liblvm_lock_owner and
+ * liblvm_lock_depth are only ever touched with the GIL held, which is what
+ * keeps them consistent, so LVM_LOCK() and LVM_UNLOCK() must not be used
+ * inside Py_BEGIN_ALLOW_THREADS.
+ */
+static PyThread_type_lock liblvm_lock;
+static long liblvm_lock_owner;
+static int liblvm_lock_depth;
 
+/* An lvm handle with its own locking settings, see liblvm_side_get() */
 typedef struct {
+	lvm_t h;
+	int vgs;			/* VGs open through it */
+	int stale;			/* settings out of date, no new opens */
+} lvmside_t;
+
+typedef struct vgobject {
 	PyObject_HEAD
 	vg_t      vg;		    /* vg handle */
+	PyThread_type_lock lock;    /* protects vg */
+	int       nolock;	    /* read without the VG lock */
+	lvmside_t *side;	    /* handle it came from, NULL for libh */
+	char      name[128];	    /* for lock accounting */
+	int       write;
+	double    opened_ms;
+	struct vgobject *prev;	    /* on liblvm_open_vgs while open */
+	struct vgobject *next;
 } vgobject;
 
 typedef struct {
@@ -61,33 +120,377 @@ static PyTypeObject LibLVMlvType;
 static PyTypeObject LibLVMpvType;
 static PyTypeObject LibLVMlvsegType;
 static PyTypeObject LibLVMpvsegType;
+static PyTypeObject LibLVMsegtableType;
+static PyTypeObject LibLVMinventoryType;
+static PyTypeObject LibLVMwatchType;
+static PyTypeObject LibLVMinvreaderType;
+static PyTypeObject LibLVMbrokerType;
+static PyTypeObject LibLVMlvattrsType;
+static PyTypeObject LibLVMpvattrsType;
+static PyTypeObject LibLVMvgattrsType;
+static PyTypeObject LibLVMmoveType;
 
 static PyObject *LibLVMError;
+static PyObject *LibLVMLockBusy;
+
+static void liblvm_tagindex_refresh(vg_t vg);
+static void liblvm_tagindex_drop(const char *vg, const char *lv);
+
+/*
+ * Take one of our locks.  Never wait for it while holding the GIL: the
+ * owner may be waiting for the GIL to finish up.
+ */
+static void
+liblvm_acquire(PyThread_type_lock lock)
+{
+	if (PyThread_acquire_lock(lock, NOWAIT_LOCK))
+		return;
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(lock, WAIT_LOCK);
+	Py_END_ALLOW_THREADS
+}
 
+static int liblvm_lazy_init(void);
+
+/* The library is initialized on first use rather than at import */
 #define LVM_VALID()							\
 	do {								\
-		if (!libh) {						\
-			PyErr_SetString(PyExc_UnboundLocalError, "LVM handle invalid"); \
+		if (!libh && liblvm_lazy_init() < 0)			\
 			return NULL;					\
-		}							\
 	} while (0)
 
+static void
+liblvm_lock_acquire(void)
+{
+	long me = PyThread_get_thread_ident();
+
+	if (liblvm_lock_depth && liblvm_lock_owner == me) {
+		liblvm_lock_depth++;
+		return;
+	}
+
+	liblvm_acquire(liblvm_lock);
+	liblvm_lock_owner = me;
+	liblvm_lock_depth = 1;
+}
+
+static void
+liblvm_lock_release(void)
+{
+	if (--liblvm_lock_depth == 0)
+		PyThread_release_lock(liblvm_lock);
+}
+
+#define LVM_LOCK()	liblvm_lock_acquire()
+#define LVM_UNLOCK()	liblvm_lock_release()
+
+/*
+ * Settings for lvm_init(), kept so that lvm.reinit() and a lazy init after
+ * lvm.init() build the same context.  Protected by liblvm_lock.
+ */
+static char *liblvm_system_dir;
+static char *liblvm_config;
+static int liblvm_exiting;
+
+/* Open VG handles live in libh's memory, so they pin it */
+static int liblvm_vg_count;
+
+/* Locking overrides for lockless and non-blocking opens */
+#define LIBLVM_LOCKING_NONE	1
+#define LIBLVM_LOCKING_NOWAIT	2
+
+/* Handles for the locking overrides, by LIBLVM_LOCKING_* */
+static lvmside_t *liblvm_side[3];
+
+static void liblvm_side_put(lvmside_t *side);
+static void liblvm_side_retire(void);
+
+/* Caller holds liblvm_lock and libh is NULL */
+static int
+liblvm_lib_init(void)
+{
+	lvm_t h;
+	int rval = 0;
+
+	if (liblvm_exiting) {
+		PyErr_SetString(PyExc_UnboundLocalError, "LVM handle invalid");
+		return -1;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	h = lvm_init(liblvm_system_dir);
+	if (h && !lvm_errno(h) && liblvm_config &&
+	    (lvm_config_override(h, liblvm_config) == -1 ||
+	     lvm_config_reload(h) == -1))
+		rval = -1;
+	Py_END_ALLOW_THREADS
+
+	if (!h) {
+		PyErr_SetString(LibLVMError, "lvm_init failed");
+		return -1;
+	}
+
+	if (rval == -1 || lvm_errno(h)) {
+		PyObject *info = Py_BuildValue("(is)", lvm_errno(h), lvm_errmsg(h));
+
+		if (info) {
+			PyErr_SetObject(LibLVMError, info);
+			Py_DECREF(info);
+		}
+		lvm_quit(h);
+		return -1;
+	}
+
+	libh = h;
+	return 0;
+}
+
+static int
+liblvm_lazy_init(void)
+{
+	int rval = 0;
+
+	LVM_LOCK();
+	if (!libh)
+		rval = liblvm_lib_init();
+	LVM_UNLOCK();
+
+	return rval;
+}
+
+/* Caller holds liblvm_lock */
+static int
+liblvm_lib_set_options(const char *system_dir, const char *config)
+{
+	char *dir = NULL;
+	char *cfg = NULL;
+
+	if ((system_dir && !(dir = strdup(system_dir))) ||
+	    (config && !(cfg = strdup(config)))) {
+		free(dir);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	free(liblvm_system_dir);
+	free(liblvm_config);
+	liblvm_system_dir = dir;
+	liblvm_config = cfg;
+
+	return 0;
+}
+
+static char *liblvm_init_kwlist[] = { "system_dir", "config_override", NULL };
+
+/*
+ * Initializes the library now instead of on first use, e.g. to pay for
+ * reading lvm.conf and the device scan at daemon startup.  system_dir is
+ * the LVM system directory (LVM_SYSTEM_DIR, /etc/lvm by default) and
+ * config_override a config string as for configOverride(), applied to
+ * every later reinit() too.  Fails if the library is already initialized
+ * with different settings; use reinit() for that.
+ */
+static PyObject *
+liblvm_lvm_init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *system_dir = NULL;
+	const char *config = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|zz", liblvm_init_kwlist,
+					 &system_dir, &config))
+		return NULL;
+
+	LVM_LOCK();
+	if (libh) {
+		if ((system_dir || config) &&
+		    (!liblvm_system_dir != !system_dir ||
+		     (system_dir && strcmp(system_dir, liblvm_system_dir)) ||
+		     !liblvm_config != !config ||
+		     (config && strcmp(config, liblvm_config)))) {
+			PyErr_Format(PyExc_ValueError,
+				     "already initialized, use reinit() to change settings");
+			goto bail;
+		}
+	} else if (liblvm_lib_set_options(system_dir, config) < 0 ||
+		   liblvm_lib_init() < 0) {
+		goto bail;
+	}
+	LVM_UNLOCK();
+
+	Py_INCREF(Py_None);
+	return Py_None;
+
+bail:
+	LVM_UNLOCK();
+	return NULL;
+}
+
+/*
+ * Tears the library context down and builds a new one, with new settings
+ * if given.  Every VG must be closed first.
+ */
 static PyObject *
-liblvm_get_last_error(void)
+liblvm_lvm_reinit(PyObject *self, PyObject *args, PyObject *kwds)
 {
-	PyObject *info;
+	const char *system_dir = NULL;
+	const char *config = NULL;
 
-	LVM_VALID();
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|zz", liblvm_init_kwlist,
+					 &system_dir, &config))
+		return NULL;
+
+	LVM_LOCK();
+	if (liblvm_vg_count) {
+		PyErr_Format(PyExc_ValueError, "%d VG(s) still open",
+			     liblvm_vg_count);
+		goto bail;
+	}
+
+	if ((system_dir || config) &&
+	    liblvm_lib_set_options(system_dir, config) < 0)
+		goto bail;
+
+	liblvm_side_retire();
+	if (libh) {
+		Py_BEGIN_ALLOW_THREADS
+		lvm_quit(libh);
+		Py_END_ALLOW_THREADS
+		libh = NULL;
+	}
+
+	if (liblvm_lib_init() < 0)
+		goto bail;
+	LVM_UNLOCK();
+
+	Py_INCREF(Py_None);
+	return Py_None;
+
+bail:
+	LVM_UNLOCK();
+	return NULL;
+}
+
+/* Caller must hold liblvm_lock */
+static PyObject *
+liblvm_get_handle_error(lvm_t h)
+{
+	PyObject *info;
 
 	if ((info = PyTuple_New(2)) == NULL)
 		return NULL;
 
-	PyTuple_SetItem(info, 0, PyInt_FromLong((long) lvm_errno(libh)));
-	PyTuple_SetItem(info, 1, PyString_FromString(lvm_errmsg(libh)));
+	PyTuple_SetItem(info, 0, PyInt_FromLong((long) lvm_errno(h)));
+	PyTuple_SetItem(info, 1, PyString_FromString(lvm_errmsg(h)));
 
 	return info;
 }
 
+/* Caller must hold liblvm_lock, the error state lives in libh */
+static PyObject *
+liblvm_get_last_error(void)
+{
+	LVM_VALID();
+
+	return liblvm_get_handle_error(libh);
+}
+
+/*
+ * Error state of the handle a VG was opened through, which for lockless
+ * and timed opens isn't libh.  vgobj may be NULL for libh.  Caller must
+ * hold liblvm_lock.
+ */
+static PyObject *
+liblvm_get_vg_error(vgobject *vgobj)
+{
+	if (!vgobj || !vgobj->side)
+		return liblvm_get_last_error();
+
+	return liblvm_get_handle_error(vgobj->side->h);
+}
+
+static int
+liblvm_vg_listed(const char *name)
+{
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+
+	if (!(vgnames = lvm_list_vg_names(libh)))
+		return -1;
+
+	dm_list_iterate_items(strl, vgnames)
+		if (!strcmp(strl->str, name))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Opens a VG that lvm_list_vg_names() returned, read-only.  A failed open
+ * only means the VG is gone if it isn't listed any more: then NULL comes
+ * back with *gone set.  Otherwise NULL comes back with the error of a
+ * second try left in libh.  Caller holds liblvm_lock and has released
+ * the GIL.
+ */
+static vg_t
+liblvm_vg_open_listed(const char *name, int *gone)
+{
+	vg_t vg;
+	int listed;
+
+	*gone = 0;
+	if ((vg = lvm_vg_open(libh, name, "r", 0)))
+		return vg;
+
+	if (!(listed = liblvm_vg_listed(name))) {
+		*gone = 1;
+		return NULL;
+	}
+
+	/* still there: open again for an error that is its own */
+	return listed < 0 ? NULL : lvm_vg_open(libh, name, "r", 0);
+}
+
+/*
+ * Stores a Python value into prop, which came from one of the
+ * *_get_property calls so its type is known.  String values point into
+ * value, which must outlive prop.
+ */
+static int
+set_property_value(struct lvm_property_value *prop, PyObject *value,
+		   vgobject *vgobj)
+{
+	unsigned long long integer;
+
+	if (!prop->is_valid) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return -1;
+	}
+
+	if (PyString_Check(value)) {
+		if (!prop->is_string) {
+			PyErr_Format(PyExc_ValueError, "Property requires string value");
+			return -1;
+		}
+		prop->value.string = PyString_AsString(value);
+	} else if (PyInt_Check(value) || PyLong_Check(value)) {
+		if (!prop->is_integer) {
+			PyErr_Format(PyExc_ValueError, "Property requires numeric value");
+			return -1;
+		}
+		/* This will fail on negative numbers */
+		integer = PyLong_AsUnsignedLongLong(value);
+		if (integer == (unsigned long long)-1 && PyErr_Occurred())
+			return -1;
+		prop->value.integer = integer;
+	} else {
+		PyErr_Format(PyExc_ValueError, "supported value types are numeric and string");
+		return -1;
+	}
+
+	return 0;
+}
+
 static PyObject *
 liblvm_library_get_version(void)
 {
@@ -106,20 +509,27 @@ liblvm_lvm_list_vg_names(void)
 
 	LVM_VALID();
 
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
 	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
 	if (!vgnames) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
 
 	pytuple = PyTuple_New(dm_list_size(vgnames));
-	if (!pytuple)
+	if (!pytuple) {
+		LVM_UNLOCK();
 		return NULL;
+	}
 
 	dm_list_iterate_items(strl, vgnames) {
 		PyTuple_SET_ITEM(pytuple, i, PyString_FromString(strl->str));
 		i++;
 	}
+	LVM_UNLOCK();
 
 	return pytuple;
 }
@@ -134,58 +544,74 @@ liblvm_lvm_list_vg_uuids(void)
 
 	LVM_VALID();
 
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
 	uuids = lvm_list_vg_uuids(libh);
+	Py_END_ALLOW_THREADS
 	if (!uuids) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
 
 	pytuple = PyTuple_New(dm_list_size(uuids));
-	if (!pytuple)
+	if (!pytuple) {
+		LVM_UNLOCK();
 		return NULL;
+	}
 
 	dm_list_iterate_items(strl, uuids) {
 		PyTuple_SET_ITEM(pytuple, i, PyString_FromString(strl->str));
 		i++;
 	}
+	LVM_UNLOCK();
 
 	return pytuple;
 }
 
-#if 0 /* waiting until supported */
+/* Decodes a *_percent property value as returned by getProperty */
 static PyObject *
 liblvm_lvm_percent_to_float(PyObject *self, PyObject *arg)
 {
 	double converted;
-	int percent;
+	unsigned long long percent;
 
 	LVM_VALID();
 
-	if (!PyArg_ParseTuple(arg, "i", &percent))
+	/* getProperty hands these out unsigned, invalid markers included */
+	if (!PyArg_ParseTuple(arg, "K", &percent))
 		return NULL;
 
-	converted = lvm_percent_to_float(percent);
+	converted = lvm_percent_to_float((percent_t)percent);
 	return Py_BuildValue("d", converted);
 }
-#endif
 
 static PyObject *
 liblvm_lvm_vgname_from_pvid(PyObject *self, PyObject *arg)
 {
 	const char *pvid;
 	const char *vgname;
+	PyObject *rc;
 
 	LVM_VALID();
 
 	if (!PyArg_ParseTuple(arg, "s", &pvid))
 		return NULL;
 
-	if ((vgname = lvm_vgname_from_pvid(libh, pvid)) == NULL) {
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgname = lvm_vgname_from_pvid(libh, pvid);
+	Py_END_ALLOW_THREADS
+	if (vgname == NULL) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
 
-	return Py_BuildValue("s", vgname);
+	rc = Py_BuildValue("s", vgname);
+	LVM_UNLOCK();
+
+	return rc;
 }
 
 static PyObject *
@@ -193,18 +619,27 @@ liblvm_lvm_vgname_from_device(PyObject *self, PyObject *arg)
 {
 	const char *device;
 	const char *vgname;
+	PyObject *rc;
 
 	LVM_VALID();
 
 	if (!PyArg_ParseTuple(arg, "s", &device))
 		return NULL;
 
-	if ((vgname = lvm_vgname_from_device(libh, device)) == NULL) {
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgname = lvm_vgname_from_device(libh, device);
+	Py_END_ALLOW_THREADS
+	if (vgname == NULL) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
 
-	return Py_BuildValue("s", vgname);
+	rc = Py_BuildValue("s", vgname);
+	LVM_UNLOCK();
+
+	return rc;
 }
 
 
@@ -220,7 +655,11 @@ liblvm_lvm_config_find_bool(PyObject *self, PyObject *arg)
 	if (!PyArg_ParseTuple(arg, "s", &config))
 		return NULL;
 
-	if ((rval = lvm_config_find_bool(libh, config, -10)) == -10) {
+	LVM_LOCK();
+	rval = lvm_config_find_bool(libh, config, -10);
+	LVM_UNLOCK();
+
+	if (rval == -10) {
 		/* Retrieving error information yields no error in this case */
 		PyErr_Format(PyExc_ValueError, "config path not found");
 		return NULL;
@@ -239,10 +678,16 @@ liblvm_lvm_config_reload(void)
 
 	LVM_VALID();
 
-	if ((rval = lvm_config_reload(libh)) == -1) {
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_config_reload(libh);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
+	LVM_UNLOCK();
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -256,19 +701,30 @@ liblvm_lvm_scan(void)
 
 	LVM_VALID();
 
-	if ((rval = lvm_scan(libh)) == -1) {
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_scan(libh);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
 		return NULL;
 	}
+	LVM_UNLOCK();
 
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+/*
+ * The override replaces any earlier one and is kept for reinit() and for
+ * the handles behind lockless and non-blocking opens.
+ */
 static PyObject *
 liblvm_lvm_config_override(PyObject *self, PyObject *arg)
 {
 	const char *config;
+	char *saved;
 	int rval;
 
 	LVM_VALID();
@@ -276,10 +732,23 @@ liblvm_lvm_config_override(PyObject *self, PyObject *arg)
 	if (!PyArg_ParseTuple(arg, "s", &config))
 		return NULL;
 
-	if ((rval = lvm_config_override(libh, config)) == -1) {
+	if (!(saved = strdup(config)))
+		return PyErr_NoMemory();
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_config_override(libh, config);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
 		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
+		free(saved);
 		return NULL;
 	}
+	free(liblvm_config);
+	liblvm_config = saved;
+	liblvm_side_retire();
+	LVM_UNLOCK();
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -288,346 +757,1092 @@ liblvm_lvm_config_override(PyObject *self, PyObject *arg)
  * VG object initialization/deallocation
  */
 
-
-static PyObject *
-liblvm_lvm_vg_open(PyObject *self, PyObject *args)
+static vgobject *
+liblvm_vg_new(void)
 {
-	const char *vgname;
-	const char *mode = NULL;
-
 	vgobject *vgobj;
 
-	LVM_VALID();
-
-	if (!PyArg_ParseTuple(args, "s|s", &vgname, &mode)) {
-		return NULL;
-	}
-
-	if (mode == NULL)
-		mode = "r";
-
 	if ((vgobj = PyObject_New(vgobject, &LibLVMvgType)) == NULL)
 		return NULL;
 
-	if ((vgobj->vg = lvm_vg_open(libh, vgname, mode, 0))== NULL) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	vgobj->vg = NULL;
+	vgobj->nolock = 0;
+	vgobj->side = NULL;
+	vgobj->name[0] = '\0';
+	vgobj->write = 0;
+	vgobj->prev = vgobj->next = NULL;
+	if ((vgobj->lock = PyThread_allocate_lock()) == NULL) {
 		Py_DECREF(vgobj);
-		return NULL;
+		return (vgobject *)PyErr_NoMemory();
 	}
 
-	return (PyObject *)vgobj;
+	return vgobj;
 }
 
-static PyObject *
-liblvm_lvm_vg_create(PyObject *self, PyObject *args)
+/* ----------------------------------------------------------------------
+ * VG handle accounting
+ *
+ * An open VG handle holds its VG lock in LVM until it is closed, so one
+ * kept around by accident stalls every other user of the VG.  Open
+ * handles are kept on a list with their open time, and hold times are
+ * added up per VG on close, for lvm.lockStats().  All of it is protected
+ * by liblvm_lock.
+ */
+
+typedef struct vgstat {
+	struct vgstat *next;
+	char name[128];
+	unsigned long long opens;
+	double total_ms;
+	double max_ms;
+	double wait_total_ms;	/* in vgOpen() */
+	double wait_max_ms;
+	unsigned long long busy;	/* opens given up on as LockBusy */
+} vgstat_t;
+
+static vgobject *liblvm_open_vgs;
+static vgstat_t *liblvm_vg_stats;
+static double liblvm_hold_warn_ms;	/* 0: don't warn */
+
+static double
+liblvm_now_ms(void)
 {
-	const char *vgname;
-	vgobject *vgobj;
+	struct timespec ts;
 
-	LVM_VALID();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
 
-	if (!PyArg_ParseTuple(args, "s", &vgname)) {
-		return NULL;
-	}
+static vgstat_t *
+liblvm_vg_stat(const char *name)
+{
+	vgstat_t *st;
 
-	if ((vgobj = PyObject_New(vgobject, &LibLVMvgType)) == NULL)
-		return NULL;
+	for (st = liblvm_vg_stats; st; st = st->next)
+		if (!strcmp(st->name, name))
+			return st;
 
-	if ((vgobj->vg = lvm_vg_create(libh, vgname))== NULL) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
-		Py_DECREF(vgobj);
-		return NULL;
+	if ((st = calloc(1, sizeof(*st)))) {
+		snprintf(st->name, sizeof(st->name), "%s", name);
+		st->next = liblvm_vg_stats;
+		liblvm_vg_stats = st;
 	}
 
-	return (PyObject *)vgobj;
+	return st;
 }
 
+/* Caller holds liblvm_lock */
 static void
-liblvm_vg_dealloc(vgobject *self)
+liblvm_vg_opened(vgobject *vgobj, const char *name, int write)
 {
-	/* if already closed, don't reclose it */
-	if (self->vg != NULL)
-		lvm_vg_close(self->vg);
-	PyObject_Del(self);
+	snprintf(vgobj->name, sizeof(vgobj->name), "%s", name);
+	vgobj->write = write;
+	vgobj->opened_ms = liblvm_now_ms();
+
+	vgobj->prev = NULL;
+	vgobj->next = liblvm_open_vgs;
+	if (liblvm_open_vgs)
+		liblvm_open_vgs->prev = vgobj;
+	liblvm_open_vgs = vgobj;
+	liblvm_vg_count++;
 }
 
-/* VG Methods */
+/* Caller holds liblvm_lock; returns how long the handle was held */
+static double
+liblvm_vg_closed(vgobject *vgobj)
+{
+	double held = liblvm_now_ms() - vgobj->opened_ms;
+	vgstat_t *st;
+
+	if (vgobj->prev)
+		vgobj->prev->next = vgobj->next;
+	else
+		liblvm_open_vgs = vgobj->next;
+	if (vgobj->next)
+		vgobj->next->prev = vgobj->prev;
+	vgobj->prev = vgobj->next = NULL;
+	liblvm_vg_count--;
+
+	if (vgobj->side) {
+		liblvm_side_put(vgobj->side);
+		vgobj->side = NULL;
+	}
 
-#define VG_VALID(vgobject)						\
-	do {								\
-		LVM_VALID();						\
-		if (!vgobject->vg) {					\
-			PyErr_SetString(PyExc_UnboundLocalError, "VG object invalid"); \
-			return NULL;					\
-		}							\
-	} while (0)
+	if ((st = liblvm_vg_stat(vgobj->name))) {
+		st->opens++;
+		st->total_ms += held;
+		if (held > st->max_ms)
+			st->max_ms = held;
+	}
 
-static PyObject *
-liblvm_lvm_vg_close(vgobject *self)
+	return held;
+}
+
+/* Caller holds liblvm_lock */
+static void
+liblvm_vg_waited(const char *name, double waited, int busy)
 {
-	/* if already closed, don't reclose it */
-	if (self->vg != NULL)
-		lvm_vg_close(self->vg);
+	vgstat_t *st;
 
-	self->vg = NULL;
+	if (!(st = liblvm_vg_stat(name)))
+		return;
 
-	Py_INCREF(Py_None);
-	return Py_None;
+	st->wait_total_ms += waited;
+	if (waited > st->wait_max_ms)
+		st->wait_max_ms = waited;
+	st->busy += busy;
 }
 
-static PyObject *
-liblvm_lvm_vg_get_name(vgobject *self)
+/* RuntimeWarning for a handle held past the lvm.setLockWarning() limit */
+static int
+liblvm_vg_hold_warn(vgobject *vgobj, double held, int leaked)
 {
-	VG_VALID(self);
+	char msg[256];
 
-	return Py_BuildValue("s", lvm_vg_get_name(self->vg));
-}
+	if (!liblvm_hold_warn_ms || held < liblvm_hold_warn_ms)
+		return 0;
 
+	snprintf(msg, sizeof(msg), "VG %s was held%s for %.0f ms%s", vgobj->name,
+		 vgobj->write ? " for writing" : "", held,
+		 leaked ? " and never closed" : "");
 
+	return PyErr_WarnEx(PyExc_RuntimeWarning, msg, 1);
+}
+
+/*
+ * { vgname: (opens, total_ms, max_ms, open_now, longest_open_ms,
+ *            wait_total_ms, wait_max_ms, busy) }:
+ * closed handles add to the first three, open_now and longest_open_ms
+ * are about the handles still open, and the wait figures are the time
+ * vgOpen() took to get the VG and how often it gave up with LockBusy.
+ */
 static PyObject *
-liblvm_lvm_vg_get_uuid(vgobject *self)
+liblvm_lvm_lock_stats(void)
 {
-	VG_VALID(self);
+	PyObject *stats;
+	PyObject *item;
+	vgobject *vgobj;
+	vgstat_t *st;
+	double now;
+	double longest;
+	int open_now;
+
+	if (!(stats = PyDict_New()))
+		return NULL;
+
+	LVM_LOCK();
+	now = liblvm_now_ms();
+
+	/* make sure every VG with an open handle has an entry */
+	for (vgobj = liblvm_open_vgs; vgobj; vgobj = vgobj->next)
+		liblvm_vg_stat(vgobj->name);
+
+	for (st = liblvm_vg_stats; st; st = st->next) {
+		open_now = 0;
+		longest = 0;
+		for (vgobj = liblvm_open_vgs; vgobj; vgobj = vgobj->next) {
+			if (strcmp(vgobj->name, st->name))
+				continue;
+			open_now++;
+			if (now - vgobj->opened_ms > longest)
+				longest = now - vgobj->opened_ms;
+		}
+
+		if (!(item = Py_BuildValue("(KddidddK)", st->opens, st->total_ms,
+					   st->max_ms, open_now, longest,
+					   st->wait_total_ms, st->wait_max_ms,
+					   st->busy)) ||
+		    PyDict_SetItemString(stats, st->name, item) < 0) {
+			Py_XDECREF(item);
+			Py_CLEAR(stats);
+			break;
+		}
+		Py_DECREF(item);
+	}
+	LVM_UNLOCK();
 
-	return Py_BuildValue("s", lvm_vg_get_uuid(self->vg));
+	return stats;
 }
 
+/* Warn about VG handles held longer than ms when they go away; 0 is off */
 static PyObject *
-liblvm_lvm_vg_remove(vgobject *self)
+liblvm_lvm_set_lock_warning(PyObject *self, PyObject *args)
 {
-	int rval;
+	double ms;
 
-	VG_VALID(self);
+	if (!PyArg_ParseTuple(args, "d", &ms))
+		return NULL;
 
-	if ((rval = lvm_vg_remove(self->vg)) == -1)
-		goto error;
+	if (ms < 0) {
+		PyErr_Format(PyExc_ValueError, "threshold must not be negative");
+		return NULL;
+	}
 
-	if (lvm_vg_write(self->vg) == -1)
-		goto error;
-
-	/* Not much you can do with a vg that is removed so close it */
-	if (lvm_vg_close(self->vg) == -1)
-		goto error;
-
-	self->vg = NULL;
+	liblvm_hold_warn_ms = ms;
 
 	Py_INCREF(Py_None);
 	return Py_None;
+}
 
-error:
-	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
-	return NULL;
+/*
+ * Lockless reads use LVM's read-only locking type, the one behind the
+ * --readonly command line option: metadata is read without taking any
+ * lock and every write is refused.  Opens with a timeout make LVM fail
+ * instead of waiting when a VG lock is taken, and retry themselves.
+ */
+#define LVM_NOLOCK_CONFIG	"global{locking_type=5}"
+#define LVM_NOWAIT_CONFIG	"global{wait_for_locks=0}"
+#define LVM_NOLOCK_RETRIES	5
+#define LVM_NOWAIT_BACKOFF_MS	50
+#define LVM_LOCK_DIR		"/run/lock/lvm"	/* default locking_dir */
+
+/*
+ * Locking is set up when a handle's config is loaded, and reloading a
+ * config pulls the memory out from under the VGs open on that handle.
+ * So rather than switching libh back and forth, each override gets a
+ * handle of its own, set up once with the user's settings plus the
+ * override, and libh keeps normal locking for everything else.  When the
+ * settings change the handle is retired: it takes no new opens and goes
+ * away with the last VG opened through it.  Caller holds liblvm_lock.
+ */
+static lvmside_t *
+liblvm_side_get(int locking)
+{
+	const char *override = locking == LIBLVM_LOCKING_NONE ?
+		LVM_NOLOCK_CONFIG : LVM_NOWAIT_CONFIG;
+	lvmside_t *side;
+	char *config;
+	int rval = -1;
+
+	if ((side = liblvm_side[locking]))
+		return side;
+
+	if (!(side = calloc(1, sizeof(*side))) ||
+	    !(config = malloc(strlen(override) +
+			      (liblvm_config ? strlen(liblvm_config) : 0) + 2))) {
+		free(side);
+		PyErr_NoMemory();
+		return NULL;
+	}
+	sprintf(config, "%s %s", liblvm_config ? liblvm_config : "", override);
+
+	Py_BEGIN_ALLOW_THREADS
+	if ((side->h = lvm_init(liblvm_system_dir)) && !lvm_errno(side->h) &&
+	    lvm_config_override(side->h, config) != -1 &&
+	    lvm_config_reload(side->h) != -1)
+		rval = 0;
+	Py_END_ALLOW_THREADS
+	free(config);
+
+	if (rval < 0) {
+		if (side->h) {
+			PyErr_SetObject(LibLVMError, liblvm_get_handle_error(side->h));
+			lvm_quit(side->h);
+		} else
+			PyErr_SetString(LibLVMError, "lvm_init failed");
+		free(side);
+		return NULL;
+	}
+
+	liblvm_side[locking] = side;
+	return side;
 }
 
-static PyObject *
-liblvm_lvm_vg_extend(vgobject *self, PyObject *args)
+/* A VG opened through side was closed; caller holds liblvm_lock */
+static void
+liblvm_side_put(lvmside_t *side)
 {
-	const char *device;
-	int rval;
+	if (--side->vgs || !side->stale)
+		return;
 
-	VG_VALID(self);
+	lvm_quit(side->h);
+	free(side);
+}
 
-	if (!PyArg_ParseTuple(args, "s", &device)) {
-		return NULL;
+/* The settings changed; caller holds liblvm_lock */
+static void
+liblvm_side_retire(void)
+{
+	lvmside_t *side;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (!(side = liblvm_side[i]))
+			continue;
+		liblvm_side[i] = NULL;
+		side->stale = 1;
+		if (!side->vgs) {
+			lvm_quit(side->h);
+			free(side);
+		}
 	}
+}
 
-	if ((rval = lvm_vg_extend(self->vg, device)) == -1)
-		goto error;
+/*
+ * Did the last failure on h come from a VG lock held elsewhere?  Only
+ * asked of the non-blocking handle, where a busy lock fails at once.
+ * LVM reports a failed flock() through log_error(), which usually leaves
+ * lvm_errno() unclassified, so the message is checked as well, and when
+ * neither says so the VG's lock file is probed with the same kind of
+ * lock the open wanted.
+ */
+static int
+liblvm_lock_was_busy(lvm_t h, const char *vgname, int write)
+{
+	const char *msg = lvm_errmsg(h);
+	char path[256];
+	int err = lvm_errno(h);
+	int busy = 0;
+	int fd;
+
+	if (err == EAGAIN || err == EWOULDBLOCK)
+		return 1;
+
+	if (msg && (strstr(msg, "Can't get lock") ||
+		    strstr(msg, strerror(EWOULDBLOCK))))
+		return 1;
+
+	snprintf(path, sizeof(path), "%s/V_%s", LVM_LOCK_DIR, vgname);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	if (flock(fd, (write ? LOCK_EX : LOCK_SH) | LOCK_NB) < 0)
+		busy = errno == EWOULDBLOCK;
+	/* drops the probe lock if we got it */
+	close(fd);
+
+	return busy;
+}
 
-	if (lvm_vg_write(self->vg) == -1)
-		goto error;
+/*
+ * Without the VG lock a commit can land while the metadata is being read.
+ * That shows up as a failed open or as the seqno moving between two
+ * reads, so only a read that sees the same seqno as the one before it is
+ * kept.  Caller holds liblvm_lock and has released the GIL.
+ */
+static vg_t
+liblvm_vg_open_nolock(lvm_t h, const char *vgname, int *torn)
+{
+	vg_t vg = NULL;
+	uint64_t prev = 0;
+	uint64_t seqno;
+	int i;
+
+	*torn = 0;
+	for (i = 0; i < LVM_NOLOCK_RETRIES + 1; i++) {
+		if (i > 1)
+			usleep(1000 << i);
+
+		if (!(vg = lvm_vg_open(h, vgname, "r", 0))) {
+			prev = 0;
+			continue;
+		}
 
-	Py_INCREF(Py_None);
-	return Py_None;
+		seqno = lvm_vg_get_seqno(vg);
+		if (prev && seqno == prev)
+			return vg;
 
-error:
-	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		prev = seqno;
+		lvm_vg_close(vg);
+		vg = NULL;
+	}
+
+	/* the last reads worked, they just never agreed */
+	*torn = prev != 0;
 	return NULL;
 }
 
 static PyObject *
-liblvm_lvm_vg_reduce(vgobject *self, PyObject *args)
+liblvm_lock_busy_error(const char *vgname)
 {
-	const char *device;
-	int rval;
+	PyObject *info;
+	char msg[256];
 
-	VG_VALID(self);
+	snprintf(msg, sizeof(msg), "VG %s is locked by another process", vgname);
+	if ((info = Py_BuildValue("(is)", EAGAIN, msg))) {
+		PyErr_SetObject(LibLVMLockBusy, info);
+		Py_DECREF(info);
+	}
 
-	if (!PyArg_ParseTuple(args, "s", &device)) {
+	return NULL;
+}
+
+static char *liblvm_vg_open_kwlist[] = { "name", "mode", "nolock", "timeout",
+					 "nowait", NULL };
+
+/*
+ * nolock=True opens the VG read-only without taking its lock, so frequent
+ * monitoring doesn't hold up writers.  The result is a consistent
+ * snapshot that may already be stale; vg.isLockless() tells such handles
+ * apart.  Lockless opens don't change how anything else locks.
+ *
+ * timeout (seconds) bounds the wait for a VG lock held by another process
+ * and nowait=True doesn't wait at all; either raises LockBusy when the
+ * lock isn't free in time.  Such opens go through a non-blocking handle
+ * and retry with the library lock released in between; everything else
+ * keeps waiting for locks as usual.
+ */
+static PyObject *
+liblvm_lvm_vg_open(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *vgname;
+	const char *mode = NULL;
+	double timeout = -1;
+	double start, waited;
+	int nolock = 0;
+	int nowait = 0;
+	int delay;
+	int torn = 0;
+	lvmside_t *side = NULL;
+	lvm_t h;
+
+	vgobject *vgobj;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|sidi", liblvm_vg_open_kwlist,
+					 &vgname, &mode, &nolock, &timeout, &nowait)) {
 		return NULL;
 	}
 
-	if ((rval = lvm_vg_reduce(self->vg, device)) == -1)
-		goto error;
+	if (mode == NULL)
+		mode = "r";
 
-	if (lvm_vg_write(self->vg) == -1)
-		goto error;
+	if (nolock && strcmp(mode, "r")) {
+		PyErr_Format(PyExc_ValueError, "nolock needs mode 'r'");
+		return NULL;
+	}
 
-	Py_INCREF(Py_None);
-	return Py_None;
+	if (nowait)
+		timeout = 0;
 
-error:
-	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	if ((vgobj = liblvm_vg_new()) == NULL)
+		return NULL;
+	vgobj->nolock = nolock;
+
+	start = liblvm_now_ms();
+	for (delay = 1;; delay = delay < LVM_NOWAIT_BACKOFF_MS ? delay * 2 : delay) {
+		LVM_LOCK();
+		if (nolock) {
+			if (!(side = liblvm_side_get(LIBLVM_LOCKING_NONE)))
+				goto bail;
+
+			Py_BEGIN_ALLOW_THREADS
+			vgobj->vg = liblvm_vg_open_nolock(side->h, vgname, &torn);
+			Py_END_ALLOW_THREADS
+			if (vgobj->vg)
+				break;
+
+			if (torn)
+				PyErr_Format(LibLVMError, "metadata of %s kept changing while read",
+					     vgname);
+			else
+				PyErr_SetObject(LibLVMError, liblvm_get_handle_error(side->h));
+			goto bail;
+		}
+
+		h = libh;
+		side = NULL;
+		if (timeout >= 0) {
+			if (!(side = liblvm_side_get(LIBLVM_LOCKING_NOWAIT)))
+				goto bail;
+			h = side->h;
+		}
+
+		Py_BEGIN_ALLOW_THREADS
+		vgobj->vg = lvm_vg_open(h, vgname, mode, 0);
+		Py_END_ALLOW_THREADS
+		if (vgobj->vg)
+			break;
+
+		/* only a lock held elsewhere is worth another try */
+		if (!side || !liblvm_lock_was_busy(h, vgname, strchr(mode, 'w') != NULL)) {
+			PyErr_SetObject(LibLVMError, liblvm_get_handle_error(h));
+			goto bail;
+		}
+
+		waited = liblvm_now_ms() - start;
+		if (timeout >= 0 && waited >= timeout * 1000) {
+			liblvm_vg_waited(vgname, waited, 1);
+			liblvm_lock_busy_error(vgname);
+			goto bail;
+		}
+		LVM_UNLOCK();
+
+		if (timeout >= 0 && delay > timeout * 1000 - waited)
+			delay = timeout * 1000 - waited + 1;
+		Py_BEGIN_ALLOW_THREADS
+		usleep(delay * 1000);
+		Py_END_ALLOW_THREADS
+
+		if (PyErr_CheckSignals() < 0) {
+			Py_DECREF(vgobj);
+			return NULL;
+		}
+	}
+	liblvm_vg_waited(vgname, liblvm_now_ms() - start, 0);
+	liblvm_vg_opened(vgobj, vgname, strchr(mode, 'w') != NULL);
+	if ((vgobj->side = side))
+		side->vgs++;
+	LVM_UNLOCK();
+
+	return (PyObject *)vgobj;
+
+bail:
+	LVM_UNLOCK();
+	Py_DECREF(vgobj);
 	return NULL;
 }
 
 static PyObject *
-liblvm_lvm_vg_add_tag(vgobject *self, PyObject *args)
+liblvm_lvm_vg_create(PyObject *self, PyObject *args)
 {
-	const char *tag;
-	int rval;
+	const char *vgname;
+	vgobject *vgobj;
 
-	VG_VALID(self);
+	LVM_VALID();
 
-	if (!PyArg_ParseTuple(args, "s", &tag)) {
+	if (!PyArg_ParseTuple(args, "s", &vgname)) {
 		return NULL;
 	}
-	if ((rval = lvm_vg_add_tag(self->vg, tag)) == -1)
-		goto error;
 
-	if (lvm_vg_write(self->vg) == -1)
-		goto error;
+	if ((vgobj = liblvm_vg_new()) == NULL)
+		return NULL;
 
-	return Py_BuildValue("i", rval);
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgobj->vg = lvm_vg_create(libh, vgname);
+	Py_END_ALLOW_THREADS
+	if (vgobj->vg == NULL) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
+		Py_DECREF(vgobj);
+		return NULL;
+	}
+	liblvm_vg_opened(vgobj, vgname, 1);
+	LVM_UNLOCK();
 
-error:
-	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
-	return NULL;
+	return (PyObject *)vgobj;
 }
 
+static char *liblvm_pv_create_kwlist[] = { "device", "size", "params", NULL };
+
+/*
+ * params are PV creation properties such as data_alignment,
+ * data_alignment_offset, pvmetadatacopies, pvmetadatasize and zero, so
+ * the first PE lands on the RAID or SSD stripe boundary.
+ */
 static PyObject *
-liblvm_lvm_vg_remove_tag(vgobject *self, PyObject *args)
+liblvm_lvm_pv_create(PyObject *self, PyObject *args, PyObject *kwds)
 {
-	const char *tag;
+	const char *device;
+	unsigned long long size = 0;
+	PyObject *extra = NULL;
+	pv_create_params_t params;
+	struct lvm_property_value prop;
+	PyObject *key, *value;
+	Py_ssize_t pos = 0;
+	const char *name;
 	int rval;
 
-	VG_VALID(self);
+	LVM_VALID();
 
-	if (!PyArg_ParseTuple(args, "s", &tag)) {
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|KO", liblvm_pv_create_kwlist,
+					 &device, &size, &extra))
+		return NULL;
+
+	if (extra && extra != Py_None && !PyDict_Check(extra)) {
+		PyErr_Format(PyExc_TypeError, "params must be a dict");
 		return NULL;
 	}
 
-	if ((rval = lvm_vg_remove_tag(self->vg, tag)) == -1)
-		goto error;
+	LVM_LOCK();
+	if (!(params = lvm_pv_params_create(libh, device)))
+		goto lvmerror;
 
-	if (lvm_vg_write(self->vg) == -1)
-		goto error;
+	if (size) {
+		prop = lvm_pv_params_get_property(params, "size");
+		prop.value.integer = size;
+		if (!prop.is_valid || lvm_pv_params_set_property(params, "size", &prop) == -1)
+			goto lvmerror;
+	}
+
+	while (extra && extra != Py_None && PyDict_Next(extra, &pos, &key, &value)) {
+		if (!(name = PyString_AsString(key)))
+			goto bail;
+
+		prop = lvm_pv_params_get_property(params, name);
+		if (set_property_value(&prop, value, NULL) < 0)
+			goto bail;
+
+		if (lvm_pv_params_set_property(params, name, &prop) == -1)
+			goto lvmerror;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_pv_create_adv(params);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto lvmerror;
+	LVM_UNLOCK();
 
 	Py_INCREF(Py_None);
 	return Py_None;
 
-error:
+lvmerror:
 	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+bail:
+	LVM_UNLOCK();
 	return NULL;
-
 }
 
-static PyObject *
-liblvm_lvm_vg_is_clustered(vgobject *self)
+static void
+liblvm_vg_dealloc(vgobject *self)
 {
-	PyObject *rval;
-
-	VG_VALID(self);
+	PyObject *type, *value, *traceback;
+	double held;
 
-	rval = ( lvm_vg_is_clustered(self->vg) == 1) ? Py_True : Py_False;
+	/* if already closed, don't reclose it */
+	if (self->vg != NULL && libh) {
+		LVM_LOCK();
+		lvm_vg_close(self->vg);
+		held = liblvm_vg_closed(self);
+		LVM_UNLOCK();
 
-	Py_INCREF(rval);
-	return rval;
+		PyErr_Fetch(&type, &value, &traceback);
+		if (liblvm_vg_hold_warn(self, held, 1) < 0)
+			PyErr_WriteUnraisable(Py_None);
+		PyErr_Restore(type, value, traceback);
+	}
+	if (self->lock)
+		PyThread_free_lock(self->lock);
+	PyObject_Del(self);
 }
 
-static PyObject *
-liblvm_lvm_vg_is_exported(vgobject *self)
+/* VG Methods */
+
+/* Takes the VG lock on success, so every later exit must VG_UNLOCK() */
+static int
+liblvm_vg_acquire(vgobject *self)
 {
-	PyObject *rval;
+	if (self->lock) {
+		liblvm_acquire(self->lock);
+		if (self->vg)
+			return 0;
+		PyThread_release_lock(self->lock);
+	}
 
-	VG_VALID(self);
+	PyErr_SetString(PyExc_UnboundLocalError, "VG object invalid");
+	return -1;
+}
 
-	rval = ( lvm_vg_is_exported(self->vg) == 1) ? Py_True : Py_False;
+#define VG_VALID(vgobject)						\
+	do {								\
+		LVM_VALID();						\
+		if (liblvm_vg_acquire(vgobject) < 0)			\
+			return NULL;					\
+	} while (0)
 
-	Py_INCREF(rval);
-	return rval;
-}
+#define VG_UNLOCK(vgobject)	PyThread_release_lock(vgobject->lock)
 
 static PyObject *
-liblvm_lvm_vg_is_partial(vgobject *self)
+liblvm_lvm_vg_close(vgobject *self)
 {
-	PyObject *rval;
+	double held = 0;
+
+	if (self->lock) {
+		liblvm_acquire(self->lock);
+
+		/* if already closed, don't reclose it */
+		if (self->vg != NULL) {
+			LVM_LOCK();
+			Py_BEGIN_ALLOW_THREADS
+			lvm_vg_close(self->vg);
+			Py_END_ALLOW_THREADS
+			held = liblvm_vg_closed(self);
+			LVM_UNLOCK();
+		}
 
-	VG_VALID(self);
+		self->vg = NULL;
+		VG_UNLOCK(self);
+	}
 
-	rval = ( lvm_vg_is_partial(self->vg) == 1) ? Py_True : Py_False;
+	if (liblvm_vg_hold_warn(self, held, 0) < 0)
+		return NULL;
 
-	Py_INCREF(rval);
-	return rval;
+	Py_INCREF(Py_None);
+	return Py_None;
 }
 
 static PyObject *
-liblvm_lvm_vg_get_seqno(vgobject *self)
+liblvm_lvm_vg_enter(vgobject *self)
 {
 	VG_VALID(self);
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_seqno(self->vg));
+	Py_INCREF(self);
+	return (PyObject *)self;
 }
 
+/* Closes the VG on leaving the with block; exceptions propagate */
 static PyObject *
-liblvm_lvm_vg_get_size(vgobject *self)
+liblvm_lvm_vg_exit(vgobject *self, PyObject *args)
 {
-	VG_VALID(self);
+	PyObject *rval;
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_size(self->vg));
+	if (!(rval = liblvm_lvm_vg_close(self)))
+		return NULL;
+	Py_DECREF(rval);
+
+	Py_INCREF(Py_False);
+	return Py_False;
 }
 
 static PyObject *
-liblvm_lvm_vg_get_free_size(vgobject *self)
+liblvm_lvm_vg_get_name(vgobject *self)
 {
+	PyObject *rc;
+
 	VG_VALID(self);
+	rc = Py_BuildValue("s", lvm_vg_get_name(self->vg));
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_free_size(self->vg));
+	return rc;
 }
 
+
 static PyObject *
-liblvm_lvm_vg_get_extent_size(vgobject *self)
+liblvm_lvm_vg_get_uuid(vgobject *self)
 {
+	PyObject *rc;
+
 	VG_VALID(self);
+	rc = Py_BuildValue("s", lvm_vg_get_uuid(self->vg));
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_extent_size(self->vg));
+	return rc;
 }
 
 static PyObject *
-liblvm_lvm_vg_get_extent_count(vgobject *self)
+liblvm_lvm_vg_remove(vgobject *self)
 {
+	double held;
+	int rval;
+
 	VG_VALID(self);
+	LVM_LOCK();
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_extent_count(self->vg));
-}
+	Py_BEGIN_ALLOW_THREADS
+	if ((rval = lvm_vg_remove(self->vg)) != -1)
+		rval = lvm_vg_write(self->vg);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto error;
+	liblvm_tagindex_drop(lvm_vg_get_name(self->vg), NULL);
 
-static PyObject *
-liblvm_lvm_vg_get_free_extent_count(vgobject *self)
-{
-	VG_VALID(self);
+	/* Not much you can do with a vg that is removed so close it */
+	rval = lvm_vg_close(self->vg);
+	self->vg = NULL;
+	held = liblvm_vg_closed(self);
+	if (rval == -1)
+		goto error;
+
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	if (liblvm_vg_hold_warn(self, held, 0) < 0)
+		return NULL;
+
+	Py_INCREF(Py_None);
+	return Py_None;
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_free_extent_count(self->vg));
+error:
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	return NULL;
 }
 
-/* Builds a python tuple ([string|number], bool) from a struct lvm_property_value */
 static PyObject *
-get_property(struct lvm_property_value *prop)
+liblvm_lvm_vg_extend(vgobject *self, PyObject *args)
 {
-	PyObject *pytuple;
-	PyObject *setable;
+	const char *device;
+	int rval;
 
-	if (!prop->is_valid) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	VG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &device)) {
+		VG_UNLOCK(self);
 		return NULL;
 	}
 
-	pytuple = PyTuple_New(2);
-	if (!pytuple)
-		return NULL;
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	if ((rval = lvm_vg_extend(self->vg, device)) != -1)
+		rval = lvm_vg_write(self->vg);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto error;
+	liblvm_tagindex_refresh(self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
-	if (prop->is_integer) {
-		PyTuple_SET_ITEM(pytuple, 0, Py_BuildValue("K", prop->value.integer));
-	} else {
+	Py_INCREF(Py_None);
+	return Py_None;
+
+error:
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_vg_reduce(vgobject *self, PyObject *args)
+{
+	const char *device;
+	int rval;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &device)) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	if ((rval = lvm_vg_reduce(self->vg, device)) != -1)
+		rval = lvm_vg_write(self->vg);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto error;
+	liblvm_tagindex_refresh(self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+
+error:
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_vg_add_tag(vgobject *self, PyObject *args)
+{
+	const char *tag;
+	int rval;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &tag)) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	if ((rval = lvm_vg_add_tag(self->vg, tag)) != -1)
+		rval = lvm_vg_write(self->vg);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto error;
+	liblvm_tagindex_refresh(self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return Py_BuildValue("i", rval);
+
+error:
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_vg_remove_tag(vgobject *self, PyObject *args)
+{
+	const char *tag;
+	int rval;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &tag)) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	if ((rval = lvm_vg_remove_tag(self->vg, tag)) != -1)
+		rval = lvm_vg_write(self->vg);
+	Py_END_ALLOW_THREADS
+	if (rval == -1)
+		goto error;
+	liblvm_tagindex_refresh(self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+
+error:
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_vg_is_clustered(vgobject *self)
+{
+	PyObject *rval;
+
+	VG_VALID(self);
+
+	rval = ( lvm_vg_is_clustered(self->vg) == 1) ? Py_True : Py_False;
+	VG_UNLOCK(self);
+
+	Py_INCREF(rval);
+	return rval;
+}
+
+static PyObject *
+liblvm_lvm_vg_is_exported(vgobject *self)
+{
+	PyObject *rval;
+
+	VG_VALID(self);
+
+	rval = ( lvm_vg_is_exported(self->vg) == 1) ? Py_True : Py_False;
+	VG_UNLOCK(self);
+
+	Py_INCREF(rval);
+	return rval;
+}
+
+static PyObject *
+liblvm_lvm_vg_is_partial(vgobject *self)
+{
+	PyObject *rval;
+
+	VG_VALID(self);
+
+	rval = ( lvm_vg_is_partial(self->vg) == 1) ? Py_True : Py_False;
+	VG_UNLOCK(self);
+
+	Py_INCREF(rval);
+	return rval;
+}
+
+static PyObject *
+liblvm_lvm_vg_is_lockless(vgobject *self)
+{
+	PyObject *rval;
+
+	VG_VALID(self);
+	rval = self->nolock ? Py_True : Py_False;
+	VG_UNLOCK(self);
+
+	Py_INCREF(rval);
+	return rval;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_seqno(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_seqno(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_size(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_size(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_free_size(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_free_size(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_extent_size(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_extent_size(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_extent_count(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_extent_count(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_vg_get_free_extent_count(vgobject *self)
+{
+	PyObject *rc;
+
+	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_free_extent_count(self->vg));
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+/* Builds a python tuple ([string|number], bool) from a struct lvm_property_value */
+static PyObject *
+get_property(struct lvm_property_value *prop, vgobject *vgobj)
+{
+	PyObject *pytuple;
+	PyObject *setable;
+
+	if (!prop->is_valid) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return NULL;
+	}
+
+	pytuple = PyTuple_New(2);
+	if (!pytuple)
+		return NULL;
+
+	if (prop->is_integer) {
+		PyTuple_SET_ITEM(pytuple, 0, Py_BuildValue("K", prop->value.integer));
+	} else {
 		PyTuple_SET_ITEM(pytuple, 0, PyString_FromString(prop->value.string));
 	}
 
@@ -649,14 +1864,22 @@ liblvm_lvm_vg_get_property(vgobject *self,  PyObject *args)
 {
 	const char *name;
 	struct lvm_property_value prop_value;
+	PyObject *rc;
 
 	VG_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "s", &name))
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
+	LVM_LOCK();
 	prop_value = lvm_vg_get_property(self->vg, name);
-	return get_property(&prop_value);
+	rc = get_property(&prop_value, self);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return rc;
 }
 
 static PyObject *
@@ -665,69 +1888,19 @@ liblvm_lvm_vg_set_property(vgobject *self,  PyObject *args)
 	const char *property_name = NULL;
 	PyObject *variant_type_arg = NULL;
 	struct lvm_property_value lvm_property;
-	char *string_value = NULL;
 
 	VG_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "sO", &property_name, &variant_type_arg))
+	if (!PyArg_ParseTuple(args, "sO", &property_name, &variant_type_arg)) {
+		VG_UNLOCK(self);
 		return NULL;
-
-	lvm_property = lvm_vg_get_property(self->vg, property_name);
-
-	if (!lvm_property.is_valid ) {
-		goto lvmerror;
 	}
 
-	if (PyObject_IsInstance(variant_type_arg, (PyObject*)&PyString_Type)) {
-
-		if (!lvm_property.is_string) {
-			PyErr_Format(PyExc_ValueError, "Property requires string value");
-			goto bail;
-		}
-
-		/* Based on cursory code inspection this path may cause a memory
-		   leak when calling into set_property, need to verify*/
-		string_value = strdup(PyString_AsString(variant_type_arg));
-		lvm_property.value.string = string_value;
-		if (!lvm_property.value.string) {
-			PyErr_NoMemory();
-			goto bail;
-		}
-
-	} else {
-
-		if (!lvm_property.is_integer) {
-			PyErr_Format(PyExc_ValueError, "Property requires numeric value");
-			goto bail;
-		}
-
-		if (PyObject_IsInstance(variant_type_arg, (PyObject*)&PyInt_Type)) {
-			int temp_py_int = PyInt_AsLong(variant_type_arg);
-
-			/* -1 could be valid, need to see if an exception was gen. */
-			if (temp_py_int == -1 && PyErr_Occurred()) {
-				goto bail;
-			}
-
-			if (temp_py_int < 0) {
-				PyErr_Format(PyExc_ValueError, "Positive integers only!");
-				goto bail;
-			}
-
-			lvm_property.value.integer = temp_py_int;
-		} else if (PyObject_IsInstance(variant_type_arg, (PyObject*)&PyLong_Type)){
-			/* This will fail on negative numbers */
-			unsigned long long temp_py_long = PyLong_AsUnsignedLongLong(variant_type_arg);
-			if (temp_py_long == (unsigned long long)-1) {
-				goto bail;
-			}
+	LVM_LOCK();
+	lvm_property = lvm_vg_get_property(self->vg, property_name);
 
-			lvm_property.value.integer = temp_py_long;
-		} else {
-			PyErr_Format(PyExc_ValueError, "supported value types are numeric and string");
-			goto bail;
-		}
-	}
+	if (set_property_value(&lvm_property, variant_type_arg, self) < 0)
+		goto bail;
 
 	if (lvm_vg_set_property(self->vg, property_name, &lvm_property) == -1) {
 		goto lvmerror;
@@ -736,44 +1909,55 @@ liblvm_lvm_vg_set_property(vgobject *self,  PyObject *args)
 	if (lvm_vg_write(self->vg) == -1) {
 		goto lvmerror;
 	}
+	liblvm_tagindex_refresh(self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
-	Py_DECREF(variant_type_arg);
 	Py_INCREF(Py_None);
 	return Py_None;
 
 lvmerror:
-	PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
 bail:
-	free(string_value);
-	if (variant_type_arg) {
-		Py_DECREF(variant_type_arg);
-		variant_type_arg = NULL;
-	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 	return NULL;
 }
 
 static PyObject *
 liblvm_lvm_vg_get_pv_count(vgobject *self)
 {
+	PyObject *rc;
+
 	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_pv_count(self->vg));
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_pv_count(self->vg));
+	return rc;
 }
 
 static PyObject *
 liblvm_lvm_vg_get_max_pv(vgobject *self)
 {
+	PyObject *rc;
+
 	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_max_pv(self->vg));
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_max_pv(self->vg));
+	return rc;
 }
 
 static PyObject *
 liblvm_lvm_vg_get_max_lv(vgobject *self)
 {
+	PyObject *rc;
+
 	VG_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_vg_get_max_lv(self->vg));
+	VG_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_vg_get_max_lv(self->vg));
+	return rc;
 }
 
 static PyObject *
@@ -785,13 +1969,19 @@ liblvm_lvm_vg_set_extent_size(vgobject *self, PyObject *args)
 	VG_VALID(self);
 
 	if (!PyArg_ParseTuple(args, "l", &new_size)) {
+		VG_UNLOCK(self);
 		return NULL;
 	}
 
+	LVM_LOCK();
 	if ((rval = lvm_vg_set_extent_size(self->vg, new_size)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -810,17 +2000,22 @@ liblvm_lvm_vg_list_lvs(vgobject *self)
 
 	/* unlike other LVM api calls, if there are no results, we get NULL */
 	lvs = lvm_vg_list_lvs(self->vg);
-	if (!lvs)
+	if (!lvs) {
+		VG_UNLOCK(self);
 		return Py_BuildValue("()");
+	}
 
 	pytuple = PyTuple_New(dm_list_size(lvs));
-	if (!pytuple)
+	if (!pytuple) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
 	dm_list_iterate_items(lvl, lvs) {
 		/* Create and initialize the object */
 		lvobj = PyObject_New(lvobject, &LibLVMlvType);
 		if (!lvobj) {
+			VG_UNLOCK(self);
 			Py_DECREF(pytuple);
 			return NULL;
 		}
@@ -832,6 +2027,7 @@ liblvm_lvm_vg_list_lvs(vgobject *self)
 		PyTuple_SET_ITEM(pytuple, i, (PyObject *) lvobj);
 		i++;
 	}
+	VG_UNLOCK(self);
 
 	return pytuple;
 }
@@ -846,20 +2042,27 @@ liblvm_lvm_vg_get_tags(vgobject *self)
 
 	VG_VALID(self);
 
+	LVM_LOCK();
 	tags = lvm_vg_get_tags(self->vg);
 	if (!tags) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
 
 	pytuple = PyTuple_New(dm_list_size(tags));
-	if (!pytuple)
+	if (!pytuple) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
 	dm_list_iterate_items(strl, tags) {
 		PyTuple_SET_ITEM(pytuple, i, PyString_FromString(strl->str));
 		i++;
 	}
+	VG_UNLOCK(self);
 
 	return pytuple;
 }
@@ -874,20 +2077,31 @@ liblvm_lvm_vg_create_lv_linear(vgobject *self, PyObject *args)
 	VG_VALID(self);
 
 	if (!PyArg_ParseTuple(args, "sl", &vgname, &size)) {
+		VG_UNLOCK(self);
 		return NULL;
 	}
 
-	if ((lvobj = PyObject_New(lvobject, &LibLVMlvType)) == NULL)
+	if ((lvobj = PyObject_New(lvobject, &LibLVMlvType)) == NULL) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
 	/* Initialize the parent ptr in case lv create fails and we dealloc lvobj */
 	lvobj->parent_vgobj = NULL;
 
-	if ((lvobj->lv = lvm_vg_create_lv_linear(self->vg, vgname, size)) == NULL) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	lvobj->lv = lvm_vg_create_lv_linear(self->vg, vgname, size);
+	Py_END_ALLOW_THREADS
+	if (lvobj->lv == NULL) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
 		Py_DECREF(lvobj);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
 	lvobj->parent_vgobj = self;
 	Py_INCREF(lvobj->parent_vgobj);
@@ -895,8 +2109,176 @@ liblvm_lvm_vg_create_lv_linear(vgobject *self, PyObject *args)
 	return (PyObject *)lvobj;
 }
 
-static void
-liblvm_lv_dealloc(lvobject *self)
+/* Wraps an LV that was just created in vgobj; caller holds the VG lock */
+static PyObject *
+liblvm_lv_new(vgobject *vgobj, lv_t lv)
+{
+	lvobject *lvobj;
+
+	if ((lvobj = PyObject_New(lvobject, &LibLVMlvType)) == NULL)
+		return NULL;
+
+	lvobj->parent_vgobj = vgobj;
+	Py_INCREF(lvobj->parent_vgobj);
+	lvobj->lv = lv;
+
+	return (PyObject *)lvobj;
+}
+
+/*
+ * Applies a dict of creation parameter properties (e.g. skip_zero) to
+ * params; which names are accepted is up to the installed lvm2app.
+ * Caller holds liblvm_lock.
+ */
+static int
+liblvm_lv_params_apply(vgobject *vgobj, lv_create_params_t params, PyObject *extra)
+{
+	struct lvm_property_value prop;
+	PyObject *key, *value;
+	Py_ssize_t pos = 0;
+	const char *name;
+
+	if (!extra || extra == Py_None)
+		return 0;
+
+	if (!PyDict_Check(extra)) {
+		PyErr_Format(PyExc_TypeError, "params must be a dict");
+		return -1;
+	}
+
+	while (PyDict_Next(extra, &pos, &key, &value)) {
+		if (!(name = PyString_AsString(key)))
+			return -1;
+
+		prop = lvm_lv_params_get_property(params, name);
+		if (set_property_value(&prop, value, vgobj) < 0)
+			return -1;
+
+		if (lvm_lv_params_set_property(params, name, &prop) == -1) {
+			PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Creates the LV described by params, which may be NULL if building it
+ * failed, after applying the caller's extra parameter properties.
+ */
+static PyObject *
+liblvm_lv_create(vgobject *vgobj, lv_create_params_t params, PyObject *extra)
+{
+	lv_t lv = NULL;
+
+	LVM_LOCK();
+	if (params && liblvm_lv_params_apply(vgobj, params, extra) < 0) {
+		LVM_UNLOCK();
+		return NULL;
+	}
+	if (params) {
+		Py_BEGIN_ALLOW_THREADS
+		lv = lvm_lv_create(params);
+		Py_END_ALLOW_THREADS
+	}
+	if (!lv) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		LVM_UNLOCK();
+		return NULL;
+	}
+	LVM_UNLOCK();
+
+	return liblvm_lv_new(vgobj, lv);
+}
+
+static int
+liblvm_parse_discards(const char *discards, lvm_thin_discards_t *mode)
+{
+	if (!discards || !strcmp(discards, "passdown"))
+		*mode = LVM_THIN_DISCARDS_PASSDOWN;
+	else if (!strcmp(discards, "nopassdown"))
+		*mode = LVM_THIN_DISCARDS_NO_PASSDOWN;
+	else if (!strcmp(discards, "ignore"))
+		*mode = LVM_THIN_DISCARDS_IGNORE;
+	else {
+		PyErr_Format(PyExc_ValueError,
+			     "discards must be 'passdown', 'nopassdown' or 'ignore'");
+		return -1;
+	}
+
+	return 0;
+}
+
+static char *liblvm_thin_pool_kwlist[] = {
+	"name", "size", "chunk_size", "metadata_size", "discards", "params", NULL
+};
+
+/* chunk_size and metadata_size of 0 let LVM pick */
+static PyObject *
+liblvm_lvm_vg_create_thin_pool(vgobject *self, PyObject *args, PyObject *kwds)
+{
+	const char *name;
+	unsigned long long size;
+	unsigned int chunk_size = 0;
+	unsigned long long metadata_size = 0;
+	const char *discards = NULL;
+	PyObject *extra = NULL;
+	lvm_thin_discards_t mode;
+	lv_create_params_t params;
+	PyObject *rc;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "sK|IKzO", liblvm_thin_pool_kwlist,
+					 &name, &size, &chunk_size, &metadata_size,
+					 &discards, &extra) ||
+	    liblvm_parse_discards(discards, &mode) < 0) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	params = lvm_lv_params_create_thin_pool(self->vg, name, size, chunk_size,
+						metadata_size, mode);
+	rc = liblvm_lv_create(self, params, extra);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static char *liblvm_lv_thin_kwlist[] = { "pool", "name", "size", "params", NULL };
+
+static PyObject *
+liblvm_lvm_vg_create_lv_thin(vgobject *self, PyObject *args, PyObject *kwds)
+{
+	const char *pool_name;
+	const char *name;
+	unsigned long long size;
+	PyObject *extra = NULL;
+	lv_create_params_t params;
+	PyObject *rc;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "ssK|O", liblvm_lv_thin_kwlist,
+					 &pool_name, &name, &size, &extra)) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	params = lvm_lv_params_create_thin(self->vg, pool_name, name, size);
+	rc = liblvm_lv_create(self, params, extra);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static void
+liblvm_lv_dealloc(lvobject *self)
 {
 	/* We can dealloc an object that didn't get fully created */
 	if (self->parent_vgobj)
@@ -917,17 +2299,22 @@ liblvm_lvm_vg_list_pvs(vgobject *self)
 
 	/* unlike other LVM api calls, if there are no results, we get NULL */
 	pvs = lvm_vg_list_pvs(self->vg);
-	if (!pvs)
+	if (!pvs) {
+		VG_UNLOCK(self);
 		return Py_BuildValue("()");
+	}
 
 	pytuple = PyTuple_New(dm_list_size(pvs));
-	if (!pytuple)
+	if (!pytuple) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
 	dm_list_iterate_items(pvl, pvs) {
 		/* Create and initialize the object */
 		pvobj = PyObject_New(pvobject, &LibLVMpvType);
 		if (!pvobj) {
+			VG_UNLOCK(self);
 			Py_DECREF(pytuple);
 			return NULL;
 		}
@@ -939,6 +2326,7 @@ liblvm_lvm_vg_list_pvs(vgobject *self)
 		PyTuple_SET_ITEM(pytuple, i, (PyObject *) pvobj);
 		i++;
 	}
+	VG_UNLOCK(self);
 
 	return pytuple;
 }
@@ -955,14 +2343,21 @@ liblvm_lvm_lv_from_N(vgobject *self, PyObject *arg, lv_fetch_by_N method)
 
 	VG_VALID(self);
 
-	if (!PyArg_ParseTuple(arg, "s", &id))
+	if (!PyArg_ParseTuple(arg, "s", &id)) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
+	LVM_LOCK();
 	lv = method(self->vg, id);
 	if (!lv) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
 	lvobj = PyObject_New(lvobject, &LibLVMlvType);
 	if (!lvobj) {
@@ -992,28 +2387,37 @@ static PyObject *
 liblvm_lvm_pv_from_N(vgobject *self, PyObject *arg, pv_fetch_by_N method)
 {
 	const char *id;
-	pvobject *rc;
+	pvobject *pvobj;
 	pv_t pv = NULL;
 
 	VG_VALID(self);
 
-	if (!PyArg_ParseTuple(arg, "s", &id))
+	if (!PyArg_ParseTuple(arg, "s", &id)) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
+	LVM_LOCK();
 	pv = method(self->vg, id);
 	if (!pv) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self));
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
 
-	rc = PyObject_New(pvobject, &LibLVMpvType);
-	if (!rc) {
+	pvobj = PyObject_New(pvobject, &LibLVMpvType);
+	if (!pvobj) {
 		return NULL;
 	}
 
-	Py_INCREF(self);
-	rc->pv = pv;
-	return (PyObject *)rc;
+	pvobj->parent_vgobj = self;
+	Py_INCREF(pvobj->parent_vgobj);
+
+	pvobj->pv = pv;
+	return (PyObject *)pvobj;
 }
 
 static PyObject *
@@ -1041,26 +2445,37 @@ liblvm_pv_dealloc(pvobject *self)
 	do {								\
 		VG_VALID(lvobject->parent_vgobj);			\
 		if (!lvobject->lv) {					\
+			VG_UNLOCK(lvobject->parent_vgobj);		\
 			PyErr_SetString(PyExc_UnboundLocalError, "LV object invalid"); \
 			return NULL;					\
 		}							\
 	} while (0)
 
+#define LV_UNLOCK(lvobject)	VG_UNLOCK(lvobject->parent_vgobj)
+
 
 static PyObject *
 liblvm_lvm_lv_get_name(lvobject *self)
 {
+	PyObject *rc;
+
 	LV_VALID(self);
+	rc = Py_BuildValue("s", lvm_lv_get_name(self->lv));
+	LV_UNLOCK(self);
 
-	return Py_BuildValue("s", lvm_lv_get_name(self->lv));
+	return rc;
 }
 
 static PyObject *
 liblvm_lvm_lv_get_uuid(lvobject *self)
 {
+	PyObject *rc;
+
 	LV_VALID(self);
+	rc = Py_BuildValue("s", lvm_lv_get_uuid(self->lv));
+	LV_UNLOCK(self);
 
-	return Py_BuildValue("s", lvm_lv_get_uuid(self->lv));
+	return rc;
 }
 
 static PyObject *
@@ -1070,10 +2485,18 @@ liblvm_lvm_lv_activate(lvobject *self)
 
 	LV_VALID(self);
 
-	if ((rval = lvm_lv_activate(self->lv)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_lv_activate(self->lv);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1086,10 +2509,18 @@ liblvm_lvm_lv_deactivate(lvobject *self)
 
 	LV_VALID(self);
 
-	if ((rval = lvm_lv_deactivate(self->lv)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_lv_deactivate(self->lv);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1098,16 +2529,34 @@ liblvm_lvm_lv_deactivate(lvobject *self)
 static PyObject *
 liblvm_lvm_vg_remove_lv(lvobject *self)
 {
+	char *lvname;
 	int rval;
 
 	LV_VALID(self);
 
-	if ((rval = lvm_vg_remove_lv(self->lv)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	if (!(lvname = strdup(lvm_lv_get_name(self->lv)))) {
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
+		return PyErr_NoMemory();
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_vg_remove_lv(self->lv);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
+		free(lvname);
 		return NULL;
 	}
+	liblvm_tagindex_drop(lvm_vg_get_name(self->parent_vgobj->vg), lvname);
+	free(lvname);
 
 	self->lv = NULL;
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1120,22 +2569,35 @@ liblvm_lvm_lv_get_property(lvobject *self, PyObject *args)
 {
 	const char *name;
 	struct lvm_property_value prop_value;
+	PyObject *rc;
 
 	LV_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "s", &name))
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		LV_UNLOCK(self);
 		return NULL;
+	}
 
+	/* some properties are read from device-mapper through libh */
+	LVM_LOCK();
 	prop_value = lvm_lv_get_property(self->lv, name);
-	return get_property(&prop_value);
+	rc = get_property(&prop_value, self->parent_vgobj);
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+
+	return rc;
 }
 
 static PyObject *
 liblvm_lvm_lv_get_size(lvobject *self)
 {
+	PyObject *rc;
+
 	LV_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_lv_get_size(self->lv));
+	LV_UNLOCK(self);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_lv_get_size(self->lv));
+	return rc;
 }
 
 static PyObject *
@@ -1145,7 +2607,10 @@ liblvm_lvm_lv_is_active(lvobject *self)
 
 	LV_VALID(self);
 
+	LVM_LOCK();
 	rval = ( lvm_lv_is_active(self->lv) == 1) ? Py_True : Py_False;
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(rval);
 	return rval;
@@ -1158,7 +2623,10 @@ liblvm_lvm_lv_is_suspended(lvobject *self)
 
 	LV_VALID(self);
 
+	LVM_LOCK();
 	rval = ( lvm_lv_is_suspended(self->lv) == 1) ? Py_True : Py_False;
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(rval);
 	return rval;
@@ -1173,13 +2641,19 @@ liblvm_lvm_lv_add_tag(lvobject *self, PyObject *args)
 	LV_VALID(self);
 
 	if (!PyArg_ParseTuple(args, "s", &tag)) {
+		LV_UNLOCK(self);
 		return NULL;
 	}
 
+	LVM_LOCK();
 	if ((rval = lvm_lv_add_tag(self->lv, tag)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1194,13 +2668,19 @@ liblvm_lvm_lv_remove_tag(lvobject *self, PyObject *args)
 	LV_VALID(self);
 
 	if (!PyArg_ParseTuple(args, "s", &tag)) {
+		LV_UNLOCK(self);
 		return NULL;
 	}
 
+	LVM_LOCK();
 	if ((rval = lvm_lv_remove_tag(self->lv, tag)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1216,20 +2696,27 @@ liblvm_lvm_lv_get_tags(lvobject *self)
 
 	LV_VALID(self);
 
+	LVM_LOCK();
 	tags = lvm_lv_get_tags(self->lv);
 	if (!tags) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
 
 	pytuple = PyTuple_New(dm_list_size(tags));
-	if (!pytuple)
+	if (!pytuple) {
+		LV_UNLOCK(self);
 		return NULL;
+	}
 
 	dm_list_iterate_items(strl, tags) {
 		PyTuple_SET_ITEM(pytuple, i, PyString_FromString(strl->str));
 		i++;
 	}
+	LV_UNLOCK(self);
 
 	return pytuple;
 }
@@ -1243,13 +2730,23 @@ liblvm_lvm_lv_rename(lvobject *self, PyObject *args)
 
 	LV_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "s", &new_name))
+	if (!PyArg_ParseTuple(args, "s", &new_name)) {
+		LV_UNLOCK(self);
 		return NULL;
+	}
 
-	if ((rval = lvm_lv_rename(self->lv, new_name)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_lv_rename(self->lv, new_name);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -1265,24 +2762,66 @@ liblvm_lvm_lv_resize(lvobject *self, PyObject *args)
 	LV_VALID(self);
 
 	if (!PyArg_ParseTuple(args, "l", &new_size)) {
+		LV_UNLOCK(self);
 		return NULL;
 	}
 
-	if ((rval = lvm_lv_resize(self->lv, new_size)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_lv_resize(self->lv, new_size);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
 		return NULL;
 	}
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
 
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+static char *liblvm_snapshot_kwlist[] = { "name", "max_snap_size", "params", NULL };
+
+/*
+ * With no size (or 0) the snapshot of a thin LV is itself a thin LV in
+ * the same pool and costs no copying; a size gives an old-style COW
+ * snapshot of at most that many bytes.
+ */
+static PyObject *
+liblvm_lvm_lv_snapshot(lvobject *self, PyObject *args, PyObject *kwds)
+{
+	const char *name;
+	unsigned long long max_snap_size = 0;
+	PyObject *extra = NULL;
+	lv_create_params_t params;
+	PyObject *rc;
+
+	LV_VALID(self);
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|KO", liblvm_snapshot_kwlist,
+					 &name, &max_snap_size, &extra)) {
+		LV_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	params = lvm_lv_params_create_snapshot(self->lv, name, max_snap_size);
+	rc = liblvm_lv_create(self->parent_vgobj, params, extra);
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+
+	return rc;
+}
+
 static PyObject *
 liblvm_lvm_lv_list_lvsegs(lvobject *self)
 {
-	struct dm_list  *lvsegs;
+	struct dm_list *lvsegs;
 	lvseg_list_t    *lvsegl;
-	PyObject * pytuple;
+	PyObject *pytuple;
 	lvsegobject *lvsegobj;
 	int i = 0;
 
@@ -1290,17 +2829,21 @@ liblvm_lvm_lv_list_lvsegs(lvobject *self)
 
 	lvsegs = lvm_lv_list_lvsegs(self->lv);
 	if (!lvsegs) {
+		LV_UNLOCK(self);
 		return Py_BuildValue("()");
 	}
 
 	pytuple = PyTuple_New(dm_list_size(lvsegs));
-	if (!pytuple)
+	if (!pytuple) {
+		LV_UNLOCK(self);
 		return NULL;
+	}
 
 	dm_list_iterate_items(lvsegl, lvsegs) {
 		/* Create and initialize the object */
 		lvsegobj = PyObject_New(lvsegobject, &LibLVMlvsegType);
 		if (!lvsegobj) {
+			LV_UNLOCK(self);
 			Py_DECREF(pytuple);
 			return NULL;
 		}
@@ -1312,202 +2855,6871 @@ liblvm_lvm_lv_list_lvsegs(lvobject *self)
 		PyTuple_SET_ITEM(pytuple, i, (PyObject *) lvsegobj);
 		i++;
 	}
+	LV_UNLOCK(self);
+
+	return pytuple;
+}
+
+/* PV Methods */
+
+#define PV_VALID(pvobject)						\
+	do {								\
+		VG_VALID(pvobject->parent_vgobj);			\
+		if (!pvobject->pv) {					\
+			VG_UNLOCK(pvobject->parent_vgobj);		\
+			PyErr_SetString(PyExc_UnboundLocalError, "PV object invalid"); \
+			return NULL;					\
+		}							\
+	} while (0)
+
+#define PV_UNLOCK(pvobject)	VG_UNLOCK(pvobject->parent_vgobj)
+
+static PyObject *
+liblvm_lvm_pv_get_name(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("s", lvm_pv_get_name(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_uuid(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("s", lvm_pv_get_uuid(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_mda_count(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_pv_get_mda_count(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_property(pvobject *self, PyObject *args)
+{
+	const char *name;
+	struct lvm_property_value prop_value;
+	PyObject *rc;
+
+	PV_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		PV_UNLOCK(self);
+		return NULL;
+	}
+
+	/* some properties are read from device-mapper through libh */
+	LVM_LOCK();
+	prop_value = lvm_pv_get_property(self->pv, name);
+	rc = get_property(&prop_value, self->parent_vgobj);
+	LVM_UNLOCK();
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_dev_size(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_pv_get_dev_size(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_size(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_pv_get_size(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_get_free(pvobject *self)
+{
+	PyObject *rc;
+
+	PV_VALID(self);
+	rc = Py_BuildValue("K", (unsigned long long)lvm_pv_get_free(self->pv));
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_resize(pvobject *self, PyObject *args)
+{
+	uint64_t new_size;
+	int rval;
+
+	PV_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "l", &new_size)) {
+		PV_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = lvm_pv_resize(self->pv, new_size);
+	Py_END_ALLOW_THREADS
+	if (rval == -1) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(self->parent_vgobj));
+		LVM_UNLOCK();
+		PV_UNLOCK(self);
+		return NULL;
+	}
+	LVM_UNLOCK();
+	PV_UNLOCK(self);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject *
+liblvm_lvm_pv_list_pvsegs(pvobject *self)
+{
+	struct dm_list *pvsegs;
+	pvseg_list_t *pvsegl;
+	PyObject *pytuple;
+	pvsegobject *pvsegobj;
+	int i = 0;
+
+	PV_VALID(self);
+
+	pvsegs = lvm_pv_list_pvsegs(self->pv);
+	if (!pvsegs) {
+		PV_UNLOCK(self);
+		return Py_BuildValue("()");
+	}
+
+	pytuple = PyTuple_New(dm_list_size(pvsegs));
+	if (!pytuple) {
+		PV_UNLOCK(self);
+		return NULL;
+	}
+
+	dm_list_iterate_items(pvsegl, pvsegs) {
+		/* Create and initialize the object */
+		pvsegobj = PyObject_New(pvsegobject, &LibLVMpvsegType);
+		if (!pvsegobj) {
+			PV_UNLOCK(self);
+			Py_DECREF(pytuple);
+			return NULL;
+		}
+
+		pvsegobj->parent_pvobj = self;
+		Py_INCREF(pvsegobj->parent_pvobj);
+
+		pvsegobj->pv_seg = pvsegl->pvseg;
+		PyTuple_SET_ITEM(pytuple, i, (PyObject *) pvsegobj);
+		i++;
+	}
+	PV_UNLOCK(self);
+
+	return pytuple;
+}
+
+/* LV seg methods */
+
+/*
+ * No way to close/destroy an lvseg, just need to make sure parents are
+ * still good
+ */
+#define LVSEG_VALID(lvsegobject) LV_VALID(lvsegobject->parent_lvobj)
+#define LVSEG_UNLOCK(lvsegobject) LV_UNLOCK(lvsegobject->parent_lvobj)
+
+static void
+liblvm_lvseg_dealloc(lvsegobject *self)
+{
+	Py_DECREF(self->parent_lvobj);
+	PyObject_Del(self);
+}
+
+static PyObject *
+liblvm_lvm_lvseg_get_property(lvsegobject *self, PyObject *args)
+{
+	const char *name;
+	struct lvm_property_value prop_value;
+	PyObject *rc;
+
+	LVSEG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		LVSEG_UNLOCK(self);
+		return NULL;
+	}
+
+	/* some properties are read from device-mapper through libh */
+	LVM_LOCK();
+	prop_value = lvm_lvseg_get_property(self->lv_seg, name);
+	rc = get_property(&prop_value, self->parent_lvobj->parent_vgobj);
+	LVM_UNLOCK();
+	LVSEG_UNLOCK(self);
+
+	return rc;
+}
+
+/* PV seg methods */
+
+/*
+ * No way to close/destroy a pvseg, just need to make sure parents are
+ * still good
+ */
+#define PVSEG_VALID(pvsegobject) PV_VALID(pvsegobject->parent_pvobj)
+#define PVSEG_UNLOCK(pvsegobject) PV_UNLOCK(pvsegobject->parent_pvobj)
+
+static void
+liblvm_pvseg_dealloc(pvsegobject *self)
+{
+	Py_DECREF(self->parent_pvobj);
+	PyObject_Del(self);
+}
+
+static PyObject *
+liblvm_lvm_pvseg_get_property(pvsegobject *self, PyObject *args)
+{
+	const char *name;
+	struct lvm_property_value prop_value;
+	PyObject *rc;
+
+	PVSEG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		PVSEG_UNLOCK(self);
+		return NULL;
+	}
+
+	/* some properties are read from device-mapper through libh */
+	LVM_LOCK();
+	prop_value = lvm_pvseg_get_property(self->pv_seg, name);
+	rc = get_property(&prop_value, self->parent_pvobj->parent_vgobj);
+	LVM_UNLOCK();
+	PVSEG_UNLOCK(self);
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------
+ * Segment tables
+ *
+ * Packed arrays of segment records built in one pass over the VG and
+ * exported through the buffer protocol, so memoryview or numpy can read
+ * them without a getProperty() call per field per segment.  The records
+ * are copies; a table stays valid after its VG is closed.
+ */
+
+typedef struct {
+	uint64_t lv_index;	/* index into vg.listLVs() */
+	uint64_t start;		/* seg_start, bytes into the LV */
+	uint64_t size;		/* seg_size, bytes */
+	uint64_t start_pe;	/* seg_start_pe, first logical extent */
+	int64_t  pv_index;	/* first PV backing it, index into vg.listPVs(), or -1 */
+	uint64_t pe_start;	/* first physical extent used on that PV */
+	uint64_t stripes;
+} lvseg_entry_t;
+
+#define LVSEG_ENTRY_FORMAT						\
+	"T{Q:lv_index:Q:start:Q:size:Q:start_pe:q:pv_index:Q:pe_start:Q:stripes:}"
+
+typedef struct {
+	uint64_t pv_index;	/* index into vg.listPVs() */
+	uint64_t start;		/* pvseg_start, physical extent */
+	uint64_t size;		/* pvseg_size, extents */
+} pvseg_entry_t;
+
+#define PVSEG_ENTRY_FORMAT "T{Q:pv_index:Q:start:Q:size:}"
+
+typedef struct {
+	PyObject_HEAD
+	char	   *data;
+	Py_ssize_t count;
+	Py_ssize_t alloc;
+	Py_ssize_t itemsize;
+	const char *format;
+} segtableobject;
+
+static segtableobject *
+liblvm_segtable_new(Py_ssize_t itemsize, const char *format)
+{
+	segtableobject *table;
+
+	if ((table = PyObject_New(segtableobject, &LibLVMsegtableType)) == NULL)
+		return NULL;
+
+	table->data = NULL;
+	table->count = 0;
+	table->alloc = 0;
+	table->itemsize = itemsize;
+	table->format = format;
+
+	return table;
+}
+
+/* Returns a zeroed record at the end of the table, or NULL if out of memory */
+static void *
+liblvm_segtable_append(segtableobject *table)
+{
+	Py_ssize_t alloc;
+	char *data;
+
+	if (table->count == table->alloc) {
+		alloc = table->alloc ? table->alloc * 2 : 16;
+		if ((data = realloc(table->data, alloc * table->itemsize)) == NULL) {
+			PyErr_NoMemory();
+			return NULL;
+		}
+		table->data = data;
+		table->alloc = alloc;
+	}
+
+	data = table->data + table->count++ * table->itemsize;
+	memset(data, 0, table->itemsize);
+
+	return data;
+}
+
+static void
+liblvm_segtable_dealloc(segtableobject *self)
+{
+	free(self->data);
+	PyObject_Del(self);
+}
+
+static Py_ssize_t
+liblvm_segtable_length(segtableobject *self)
+{
+	return self->count;
+}
+
+static int
+liblvm_segtable_getbuffer(segtableobject *self, Py_buffer *view, int flags)
+{
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "segment table is read-only");
+		view->obj = NULL;
+		return -1;
+	}
+
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = self->data;
+	view->len = self->count * self->itemsize;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &self->count : NULL;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &self->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return 0;
+}
+
+/* Integer property of a segment; caller holds liblvm_lock */
+static int
+liblvm_lvseg_get_integer(vgobject *vgobj, lvseg_t seg, const char *name,
+			 uint64_t *value)
+{
+	struct lvm_property_value prop;
+
+	prop = lvm_lvseg_get_property(seg, name);
+	if (!prop.is_valid || !prop.is_integer) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return -1;
+	}
+
+	*value = prop.value.integer;
+	return 0;
+}
+
+static int
+liblvm_pvseg_get_integer(vgobject *vgobj, pvseg_t seg, const char *name,
+			 uint64_t *value)
+{
+	struct lvm_property_value prop;
+
+	prop = lvm_pvseg_get_property(seg, name);
+	if (!prop.is_valid || !prop.is_integer) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return -1;
+	}
+
+	*value = prop.value.integer;
+	return 0;
+}
+
+/*
+ * Resolve the first entry of a "devices" string such as "/dev/sdb(0),..."
+ * to an index into the VG's PV list and a starting extent.  Segments that
+ * aren't backed by a PV directly (thin, snapshot, ...) come back as -1.
+ */
+static void
+liblvm_lvseg_first_pv(const char *devices, struct dm_list *pvs,
+		      int64_t *pv_index, uint64_t *pe_start)
+{
+	struct lvm_pv_list *pvl;
+	const char *paren;
+	const char *name;
+	size_t len;
+	int64_t i = 0;
+
+	*pv_index = -1;
+	*pe_start = 0;
+
+	if (!devices || !pvs || !(paren = strchr(devices, '(')))
+		return;
+
+	len = paren - devices;
+	dm_list_iterate_items(pvl, pvs) {
+		name = lvm_pv_get_name(pvl->pv);
+		if (strlen(name) == len && !strncmp(name, devices, len)) {
+			*pv_index = i;
+			*pe_start = strtoull(paren + 1, NULL, 10);
+			return;
+		}
+		i++;
+	}
+}
+
+/* Caller holds the VG lock and liblvm_lock */
+static int
+liblvm_lvsegs_to_table(segtableobject *table, vgobject *vgobj, lv_t lv, uint64_t lv_index,
+		       struct dm_list *pvs)
+{
+	struct dm_list *lvsegs;
+	lvseg_list_t *lvsegl;
+	lvseg_entry_t *entry;
+	struct lvm_property_value devices;
+
+	if (!(lvsegs = lvm_lv_list_lvsegs(lv)))
+		return 0;
+
+	dm_list_iterate_items(lvsegl, lvsegs) {
+		if (!(entry = liblvm_segtable_append(table)))
+			return -1;
+
+		entry->lv_index = lv_index;
+		if (liblvm_lvseg_get_integer(vgobj, lvsegl->lvseg, "seg_start", &entry->start) ||
+		    liblvm_lvseg_get_integer(vgobj, lvsegl->lvseg, "seg_size", &entry->size) ||
+		    liblvm_lvseg_get_integer(vgobj, lvsegl->lvseg, "seg_start_pe", &entry->start_pe) ||
+		    liblvm_lvseg_get_integer(vgobj, lvsegl->lvseg, "stripes", &entry->stripes))
+			return -1;
+
+		devices = lvm_lvseg_get_property(lvsegl->lvseg, "devices");
+		liblvm_lvseg_first_pv(devices.is_valid && devices.is_string ?
+				      devices.value.string : NULL,
+				      pvs, &entry->pv_index, &entry->pe_start);
+	}
+
+	return 0;
+}
+
+/* Caller holds the VG lock and liblvm_lock */
+static int
+liblvm_pvsegs_to_table(segtableobject *table, vgobject *vgobj, pv_t pv,
+		       uint64_t pv_index)
+{
+	struct dm_list *pvsegs;
+	pvseg_list_t *pvsegl;
+	pvseg_entry_t *entry;
+
+	if (!(pvsegs = lvm_pv_list_pvsegs(pv)))
+		return 0;
+
+	dm_list_iterate_items(pvsegl, pvsegs) {
+		if (!(entry = liblvm_segtable_append(table)))
+			return -1;
+
+		entry->pv_index = pv_index;
+		if (liblvm_pvseg_get_integer(vgobj, pvsegl->pvseg, "pvseg_start", &entry->start) ||
+		    liblvm_pvseg_get_integer(vgobj, pvsegl->pvseg, "pvseg_size", &entry->size))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Position of lv/pv in the VG's list, which is the order listLVs/listPVs use */
+static uint64_t
+liblvm_lv_index(vg_t vg, lv_t lv)
+{
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	uint64_t i = 0;
+
+	if ((lvs = lvm_vg_list_lvs(vg))) {
+		dm_list_iterate_items(lvl, lvs) {
+			if (lvl->lv == lv)
+				break;
+			i++;
+		}
+	}
+
+	return i;
+}
+
+static uint64_t
+liblvm_pv_index(struct dm_list *pvs, pv_t pv)
+{
+	struct lvm_pv_list *pvl;
+	uint64_t i = 0;
+
+	if (pvs) {
+		dm_list_iterate_items(pvl, pvs) {
+			if (pvl->pv == pv)
+				break;
+			i++;
+		}
+	}
+
+	return i;
+}
+
+static PyObject *
+liblvm_lvm_vg_lvseg_table(vgobject *self)
+{
+	struct dm_list *lvs;
+	struct dm_list *pvs;
+	struct lvm_lv_list *lvl;
+	segtableobject *table;
+	uint64_t i = 0;
+
+	VG_VALID(self);
+
+	if (!(table = liblvm_segtable_new(sizeof(lvseg_entry_t), LVSEG_ENTRY_FORMAT))) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	pvs = lvm_vg_list_pvs(self->vg);
+	if ((lvs = lvm_vg_list_lvs(self->vg))) {
+		dm_list_iterate_items(lvl, lvs) {
+			if (liblvm_lvsegs_to_table(table, self, lvl->lv, i++, pvs) < 0)
+				goto error;
+		}
+	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return (PyObject *)table;
+
+error:
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	Py_DECREF(table);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_vg_pvseg_table(vgobject *self)
+{
+	struct dm_list *pvs;
+	struct lvm_pv_list *pvl;
+	segtableobject *table;
+	uint64_t i = 0;
+
+	VG_VALID(self);
+
+	if (!(table = liblvm_segtable_new(sizeof(pvseg_entry_t), PVSEG_ENTRY_FORMAT))) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	if ((pvs = lvm_vg_list_pvs(self->vg))) {
+		dm_list_iterate_items(pvl, pvs) {
+			if (liblvm_pvsegs_to_table(table, self, pvl->pv, i++) < 0)
+				goto error;
+		}
+	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return (PyObject *)table;
+
+error:
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	Py_DECREF(table);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_lv_seg_table(lvobject *self)
+{
+	vg_t vg;
+	segtableobject *table;
+	int rval;
+
+	LV_VALID(self);
+
+	if (!(table = liblvm_segtable_new(sizeof(lvseg_entry_t), LVSEG_ENTRY_FORMAT))) {
+		LV_UNLOCK(self);
+		return NULL;
+	}
+
+	vg = self->parent_vgobj->vg;
+	LVM_LOCK();
+	rval = liblvm_lvsegs_to_table(table, self->parent_vgobj, self->lv, liblvm_lv_index(vg, self->lv),
+				      lvm_vg_list_pvs(vg));
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+
+	if (rval < 0) {
+		Py_DECREF(table);
+		return NULL;
+	}
+
+	return (PyObject *)table;
+}
+
+static PyObject *
+liblvm_lvm_pv_seg_table(pvobject *self)
+{
+	segtableobject *table;
+	int rval;
+
+	PV_VALID(self);
+
+	if (!(table = liblvm_segtable_new(sizeof(pvseg_entry_t), PVSEG_ENTRY_FORMAT))) {
+		PV_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	rval = liblvm_pvsegs_to_table(table, self->parent_vgobj, self->pv,
+				      liblvm_pv_index(lvm_vg_list_pvs(self->parent_vgobj->vg),
+						      self->pv));
+	LVM_UNLOCK();
+	PV_UNLOCK(self);
+
+	if (rval < 0) {
+		Py_DECREF(table);
+		return NULL;
+	}
+
+	return (PyObject *)table;
+}
+
+/* ----------------------------------------------------------------------
+ * Inventory serialization
+ *
+ * Walks a VG's property lists and encodes them straight into a growing
+ * byte buffer as JSON or msgpack, optionally streaming it to a file
+ * descriptor, instead of building dicts in Python first.
+ */
+
+#define OUTBUF_FLUSH_SIZE	(64 * 1024)
+
+typedef struct {
+	int msgpack;
+	int fd;			/* stream to this fd when >= 0 */
+	char *data;
+	size_t len;
+	size_t alloc;
+	int error;		/* errno of the first failure */
+} outbuf_t;
+
+static void
+outbuf_flush(outbuf_t *out)
+{
+	size_t done = 0;
+	ssize_t rval;
+
+	if (out->fd < 0 || out->error)
+		return;
+
+	Py_BEGIN_ALLOW_THREADS
+	while (done < out->len) {
+		rval = write(out->fd, out->data + done, out->len - done);
+		if (rval < 0) {
+			if (errno == EINTR)
+				continue;
+			out->error = errno;
+			break;
+		}
+		done += rval;
+	}
+	Py_END_ALLOW_THREADS
+
+	out->len = 0;
+}
+
+static void
+outbuf_put(outbuf_t *out, const void *data, size_t len)
+{
+	size_t alloc;
+	char *p;
+
+	if (out->error)
+		return;
+
+	if (out->len + len > out->alloc) {
+		alloc = out->alloc ? out->alloc : 4096;
+		while (alloc < out->len + len)
+			alloc *= 2;
+		if ((p = realloc(out->data, alloc)) == NULL) {
+			out->error = ENOMEM;
+			return;
+		}
+		out->data = p;
+		out->alloc = alloc;
+	}
+
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+
+	if (out->len >= OUTBUF_FLUSH_SIZE)
+		outbuf_flush(out);
+}
+
+static void
+outbuf_putc(outbuf_t *out, char c)
+{
+	outbuf_put(out, &c, 1);
+}
+
+/* msgpack type byte followed by a big-endian length or value */
+static void
+outbuf_put_be(outbuf_t *out, unsigned char type, uint64_t value, int bytes)
+{
+	unsigned char buf[9];
+	int i;
+
+	buf[0] = type;
+	for (i = bytes; i > 0; i--) {
+		buf[i] = value & 0xff;
+		value >>= 8;
+	}
+
+	outbuf_put(out, buf, bytes + 1);
+}
+
+static void
+outbuf_put_header(outbuf_t *out, size_t n, unsigned char fix, size_t fixmax,
+		  unsigned char t8, unsigned char t16, unsigned char t32)
+{
+	if (n <= fixmax)
+		outbuf_putc(out, fix | n);
+	else if (t8 && n < 0x100)
+		outbuf_put_be(out, t8, n, 1);
+	else if (n < 0x10000)
+		outbuf_put_be(out, t16, n, 2);
+	else
+		outbuf_put_be(out, t32, n, 4);
+}
+
+static void
+out_map(outbuf_t *out, size_t n)
+{
+	if (out->msgpack)
+		outbuf_put_header(out, n, 0x80, 15, 0, 0xde, 0xdf);
+	else
+		outbuf_putc(out, '{');
+}
+
+static void
+out_map_end(outbuf_t *out)
+{
+	if (!out->msgpack)
+		outbuf_putc(out, '}');
+}
+
+static void
+out_array(outbuf_t *out, size_t n)
+{
+	if (out->msgpack)
+		outbuf_put_header(out, n, 0x90, 15, 0, 0xdc, 0xdd);
+	else
+		outbuf_putc(out, '[');
+}
+
+static void
+out_array_end(outbuf_t *out)
+{
+	if (!out->msgpack)
+		outbuf_putc(out, ']');
+}
+
+/* Separates the i'th member of a map or array from the previous one */
+static void
+out_next(outbuf_t *out, size_t i)
+{
+	if (!out->msgpack && i)
+		outbuf_putc(out, ',');
+}
+
+static void
+out_str(outbuf_t *out, const char *str)
+{
+	size_t len = strlen(str);
+	const char *p;
+	char esc[8];
+
+	if (out->msgpack) {
+		outbuf_put_header(out, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+		outbuf_put(out, str, len);
+		return;
+	}
+
+	outbuf_putc(out, '"');
+	for (p = str; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			outbuf_putc(out, '\\');
+			outbuf_putc(out, *p);
+		} else if ((unsigned char)*p < 0x20) {
+			snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*p);
+			outbuf_put(out, esc, 6);
+		} else
+			outbuf_putc(out, *p);
+	}
+	outbuf_putc(out, '"');
+}
+
+static void
+out_uint(outbuf_t *out, uint64_t value)
+{
+	char num[24];
+
+	if (!out->msgpack) {
+		outbuf_put(out, num, snprintf(num, sizeof(num), "%llu",
+					      (unsigned long long)value));
+		return;
+	}
+
+	if (value < 0x80)
+		outbuf_putc(out, (char)value);
+	else if (value < 0x100)
+		outbuf_put_be(out, 0xcc, value, 1);
+	else if (value < 0x10000)
+		outbuf_put_be(out, 0xcd, value, 2);
+	else if (value < 0x100000000ULL)
+		outbuf_put_be(out, 0xce, value, 4);
+	else
+		outbuf_put_be(out, 0xcf, value, 8);
+}
+
+static void
+out_nil(outbuf_t *out)
+{
+	if (out->msgpack)
+		outbuf_putc(out, (char)0xc0);
+	else
+		outbuf_put(out, "null", 4);
+}
+
+static void
+out_key(outbuf_t *out, size_t i, const char *key)
+{
+	out_next(out, i);
+	out_str(out, key);
+	if (!out->msgpack)
+		outbuf_putc(out, ':');
+}
+
+/* Properties LVM can't report for this object come out as null */
+static void
+out_property(outbuf_t *out, struct lvm_property_value *prop)
+{
+	if (!prop->is_valid)
+		out_nil(out);
+	else if (prop->is_integer)
+		out_uint(out, prop->value.integer);
+	else
+		out_str(out, prop->value.string ? prop->value.string : "");
+}
+
+typedef struct {
+	const char **names;
+	Py_ssize_t count;
+	PyObject *seq;		/* keeps names alive */
+} fieldlist_t;
+
+static const char *liblvm_default_vg_fields[] = {
+	"vg_name", "vg_uuid", "vg_size", "vg_free", "vg_extent_size",
+	"vg_extent_count", "vg_free_count", "pv_count", "lv_count",
+	"vg_seqno", "vg_attr", "vg_tags", NULL
+};
+
+static const char *liblvm_default_lv_fields[] = {
+	"lv_name", "lv_uuid", "lv_size", "lv_attr", "lv_tags", NULL
+};
+
+static const char *liblvm_default_pv_fields[] = {
+	"pv_name", "pv_uuid", "pv_size", "pv_free", "dev_size", "pv_attr",
+	"pv_tags", NULL
+};
+
+/* A sequence of property names, or None for the defaults */
+static int
+liblvm_fields_parse(PyObject *arg, const char **defaults, fieldlist_t *fields)
+{
+	Py_ssize_t i;
+
+	fields->seq = NULL;
+
+	if (!arg || arg == Py_None) {
+		fields->names = defaults;
+		for (fields->count = 0; defaults[fields->count]; fields->count++)
+			;
+		return 0;
+	}
+
+	if (!(fields->seq = PySequence_Fast(arg, "fields must be a sequence of property names")))
+		return -1;
+
+	fields->count = PySequence_Fast_GET_SIZE(fields->seq);
+	if (!(fields->names = PyMem_New(const char *, fields->count + 1))) {
+		Py_CLEAR(fields->seq);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	for (i = 0; i < fields->count; i++) {
+		fields->names[i] = PyString_AsString(PySequence_Fast_GET_ITEM(fields->seq, i));
+		if (!fields->names[i]) {
+			PyMem_Free(fields->names);
+			Py_CLEAR(fields->seq);
+			return -1;
+		}
+	}
+	fields->names[i] = NULL;
+
+	return 0;
+}
+
+static void
+liblvm_fields_release(fieldlist_t *fields)
+{
+	if (fields->seq) {
+		PyMem_Free(fields->names);
+		Py_CLEAR(fields->seq);
+	}
+}
+
+typedef struct {
+	outbuf_t out;
+	fieldlist_t vg_fields;
+	fieldlist_t lv_fields;
+	fieldlist_t pv_fields;
+} serializer_t;
+
+static int
+liblvm_serializer_init(serializer_t *s, const char *format, int fd,
+		       PyObject *vg_fields, PyObject *lv_fields, PyObject *pv_fields)
+{
+	memset(s, 0, sizeof(*s));
+	s->out.fd = fd;
+
+	if (!format || !strcmp(format, "json"))
+		s->out.msgpack = 0;
+	else if (!strcmp(format, "msgpack"))
+		s->out.msgpack = 1;
+	else {
+		PyErr_Format(PyExc_ValueError, "format must be 'json' or 'msgpack'");
+		return -1;
+	}
+
+	if (liblvm_fields_parse(vg_fields, liblvm_default_vg_fields, &s->vg_fields) < 0)
+		return -1;
+	if (liblvm_fields_parse(lv_fields, liblvm_default_lv_fields, &s->lv_fields) < 0) {
+		liblvm_fields_release(&s->vg_fields);
+		return -1;
+	}
+	if (liblvm_fields_parse(pv_fields, liblvm_default_pv_fields, &s->pv_fields) < 0) {
+		liblvm_fields_release(&s->vg_fields);
+		liblvm_fields_release(&s->lv_fields);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+liblvm_serializer_release(serializer_t *s)
+{
+	free(s->out.data);
+	liblvm_fields_release(&s->vg_fields);
+	liblvm_fields_release(&s->lv_fields);
+	liblvm_fields_release(&s->pv_fields);
+}
+
+/* Flushes any remaining output and returns the bytes, or None when streaming */
+static PyObject *
+liblvm_serializer_finish(serializer_t *s)
+{
+	PyObject *rc = NULL;
+
+	outbuf_flush(&s->out);
+
+	if (s->out.error) {
+		errno = s->out.error;
+		if (errno == ENOMEM)
+			PyErr_NoMemory();
+		else
+			PyErr_SetFromErrno(PyExc_OSError);
+	} else if (s->out.fd < 0) {
+		rc = PyString_FromStringAndSize(s->out.data ? s->out.data : "", s->out.len);
+	} else {
+		Py_INCREF(Py_None);
+		rc = Py_None;
+	}
+
+	liblvm_serializer_release(s);
+
+	return rc;
+}
+
+/* Caller holds liblvm_lock */
+static void
+liblvm_serialize_vg(serializer_t *s, vg_t vg)
+{
+	outbuf_t *out = &s->out;
+	struct dm_list *lvs = lvm_vg_list_lvs(vg);
+	struct dm_list *pvs = lvm_vg_list_pvs(vg);
+	struct lvm_lv_list *lvl;
+	struct lvm_pv_list *pvl;
+	struct lvm_property_value prop;
+	Py_ssize_t i;
+	size_t n;
+
+	out_map(out, s->vg_fields.count + 2);
+	for (i = 0; i < s->vg_fields.count; i++) {
+		out_key(out, i, s->vg_fields.names[i]);
+		prop = lvm_vg_get_property(vg, s->vg_fields.names[i]);
+		out_property(out, &prop);
+	}
+
+	out_key(out, s->vg_fields.count, "lvs");
+	out_array(out, lvs ? dm_list_size(lvs) : 0);
+	n = 0;
+	if (lvs) {
+		dm_list_iterate_items(lvl, lvs) {
+			out_next(out, n++);
+			out_map(out, s->lv_fields.count);
+			for (i = 0; i < s->lv_fields.count; i++) {
+				out_key(out, i, s->lv_fields.names[i]);
+				prop = lvm_lv_get_property(lvl->lv, s->lv_fields.names[i]);
+				out_property(out, &prop);
+			}
+			out_map_end(out);
+		}
+	}
+	out_array_end(out);
+
+	out_key(out, s->vg_fields.count + 1, "pvs");
+	out_array(out, pvs ? dm_list_size(pvs) : 0);
+	n = 0;
+	if (pvs) {
+		dm_list_iterate_items(pvl, pvs) {
+			out_next(out, n++);
+			out_map(out, s->pv_fields.count);
+			for (i = 0; i < s->pv_fields.count; i++) {
+				out_key(out, i, s->pv_fields.names[i]);
+				prop = lvm_pv_get_property(pvl->pv, s->pv_fields.names[i]);
+				out_property(out, &prop);
+			}
+			out_map_end(out);
+		}
+	}
+	out_array_end(out);
+
+	out_map_end(out);
+}
+
+static char *liblvm_serialize_kwlist[] = {
+	"format", "vg_fields", "lv_fields", "pv_fields", "fd", NULL
+};
+
+static PyObject *
+liblvm_lvm_vg_serialize(vgobject *self, PyObject *args, PyObject *kwds)
+{
+	const char *format = NULL;
+	PyObject *vg_fields = NULL, *lv_fields = NULL, *pv_fields = NULL;
+	int fd = -1;
+	serializer_t s;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sOOOi", liblvm_serialize_kwlist,
+					 &format, &vg_fields, &lv_fields, &pv_fields, &fd))
+		return NULL;
+
+	if (liblvm_serializer_init(&s, format, fd, vg_fields, lv_fields, pv_fields) < 0)
+		return NULL;
+
+	if (liblvm_vg_acquire(self) < 0) {
+		liblvm_serializer_release(&s);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	liblvm_serialize_vg(&s, self->vg);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return liblvm_serializer_finish(&s);
+}
+
+/*
+ * A map of VG name to VG for every VG on the system, each opened read-only
+ * just long enough to encode it.  A VG removed between listing and opening
+ * comes out as null; any other failure to read one raises.
+ */
+static PyObject *
+liblvm_lvm_serialize_all(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *format = NULL;
+	PyObject *vg_fields = NULL, *lv_fields = NULL, *pv_fields = NULL;
+	int fd = -1;
+	serializer_t s;
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+	vg_t vg;
+	size_t i = 0;
+	int gone;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sOOOi", liblvm_serialize_kwlist,
+					 &format, &vg_fields, &lv_fields, &pv_fields, &fd))
+		return NULL;
+
+	if (liblvm_serializer_init(&s, format, fd, vg_fields, lv_fields, pv_fields) < 0)
+		return NULL;
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
+	if (!vgnames) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
+		liblvm_serializer_release(&s);
+		return NULL;
+	}
+
+	out_map(&s.out, dm_list_size(vgnames));
+	dm_list_iterate_items(strl, vgnames) {
+		out_key(&s.out, i++, strl->str);
+
+		Py_BEGIN_ALLOW_THREADS
+		vg = liblvm_vg_open_listed(strl->str, &gone);
+		Py_END_ALLOW_THREADS
+		if (!vg && gone) {
+			out_nil(&s.out);
+			continue;
+		}
+		if (!vg) {
+			PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+			LVM_UNLOCK();
+			liblvm_serializer_release(&s);
+			return NULL;
+		}
+
+		liblvm_serialize_vg(&s, vg);
+		lvm_vg_close(vg);
+	}
+	out_map_end(&s.out);
+	LVM_UNLOCK();
+
+	return liblvm_serializer_finish(&s);
+}
+
+/* ----------------------------------------------------------------------
+ * Inventory capture and diffing
+ *
+ * An inventory is a compact C copy of what a reconciler cares about for
+ * every VG, LV and PV.  lvm.diff() compares two of them with uuid-keyed hash
+ * lookups and only looks inside a VG whose seqno changed; for the rest
+ * the metadata is identical, so just activation state and vg_attr (which
+ * shows missing PVs) are compared.
+ */
+
+typedef struct {
+	char *uuid;
+	char *name;
+	uint64_t size;
+	char *attr;
+	char *tags;
+} inv_lv_t;
+
+typedef struct {
+	char *uuid;
+	char *name;
+	uint64_t size;
+	uint64_t free;
+} inv_pv_t;
+
+typedef struct {
+	char *uuid;
+	char *name;
+	uint64_t seqno;
+	uint64_t size;
+	uint64_t free;
+	char *attr;
+	char *tags;
+	inv_lv_t *lvs;
+	size_t lv_count;
+	inv_pv_t *pvs;
+	size_t pv_count;
+} inv_vg_t;
+
+typedef struct {
+	PyObject_HEAD
+	inv_vg_t *vgs;
+	size_t vg_count;
+} inventoryobject;
+
+static void
+liblvm_inventory_dealloc(inventoryobject *self)
+{
+	size_t i, j;
+
+	for (i = 0; i < self->vg_count; i++) {
+		for (j = 0; j < self->vgs[i].lv_count; j++) {
+			free(self->vgs[i].lvs[j].uuid);
+			free(self->vgs[i].lvs[j].name);
+			free(self->vgs[i].lvs[j].attr);
+			free(self->vgs[i].lvs[j].tags);
+		}
+		free(self->vgs[i].lvs);
+		for (j = 0; j < self->vgs[i].pv_count; j++) {
+			free(self->vgs[i].pvs[j].uuid);
+			free(self->vgs[i].pvs[j].name);
+		}
+		free(self->vgs[i].pvs);
+		free(self->vgs[i].uuid);
+		free(self->vgs[i].name);
+		free(self->vgs[i].attr);
+		free(self->vgs[i].tags);
+	}
+	free(self->vgs);
+	PyObject_Del(self);
+}
+
+static Py_ssize_t
+liblvm_inventory_length(inventoryobject *self)
+{
+	return self->vg_count;
+}
+
+/* String property copied out of LVM's pool, "" if LVM can't report it */
+static char *
+liblvm_lv_property_strdup(lv_t lv, const char *name)
+{
+	struct lvm_property_value prop = lvm_lv_get_property(lv, name);
+
+	return strdup(prop.is_valid && prop.is_string && prop.value.string ?
+		      prop.value.string : "");
+}
+
+static char *
+liblvm_vg_property_strdup(vg_t vg, const char *name)
+{
+	struct lvm_property_value prop = lvm_vg_get_property(vg, name);
+
+	return strdup(prop.is_valid && prop.is_string && prop.value.string ?
+		      prop.value.string : "");
+}
+
+/* Caller holds liblvm_lock; returns -1 if out of memory */
+static int
+liblvm_inventory_capture_vg(inv_vg_t *ivg, vg_t vg)
+{
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	struct dm_list *pvs;
+	struct lvm_pv_list *pvl;
+	inv_lv_t *ilv;
+	inv_pv_t *ipv;
+
+	ivg->uuid = strdup(lvm_vg_get_uuid(vg));
+	ivg->name = strdup(lvm_vg_get_name(vg));
+	ivg->seqno = lvm_vg_get_seqno(vg);
+	ivg->size = lvm_vg_get_size(vg);
+	ivg->free = lvm_vg_get_free_size(vg);
+	ivg->attr = liblvm_vg_property_strdup(vg, "vg_attr");
+	ivg->tags = liblvm_vg_property_strdup(vg, "vg_tags");
+	if (!ivg->uuid || !ivg->name || !ivg->attr || !ivg->tags)
+		return -1;
+
+	if ((pvs = lvm_vg_list_pvs(vg))) {
+		if (!(ivg->pvs = calloc(dm_list_size(pvs), sizeof(inv_pv_t))))
+			return -1;
+
+		dm_list_iterate_items(pvl, pvs) {
+			ipv = &ivg->pvs[ivg->pv_count++];
+			ipv->uuid = strdup(lvm_pv_get_uuid(pvl->pv));
+			ipv->name = strdup(lvm_pv_get_name(pvl->pv));
+			ipv->size = lvm_pv_get_size(pvl->pv);
+			ipv->free = lvm_pv_get_free(pvl->pv);
+			if (!ipv->uuid || !ipv->name)
+				return -1;
+		}
+	}
+
+	if (!(lvs = lvm_vg_list_lvs(vg)))
+		return 0;
+
+	if (!(ivg->lvs = calloc(dm_list_size(lvs), sizeof(inv_lv_t))))
+		return -1;
+
+	dm_list_iterate_items(lvl, lvs) {
+		ilv = &ivg->lvs[ivg->lv_count++];
+		ilv->uuid = strdup(lvm_lv_get_uuid(lvl->lv));
+		ilv->name = strdup(lvm_lv_get_name(lvl->lv));
+		ilv->size = lvm_lv_get_size(lvl->lv);
+		ilv->attr = liblvm_lv_property_strdup(lvl->lv, "lv_attr");
+		ilv->tags = liblvm_lv_property_strdup(lvl->lv, "lv_tags");
+		if (!ilv->uuid || !ilv->name || !ilv->attr || !ilv->tags)
+			return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *
+liblvm_lvm_inventory(void)
+{
+	inventoryobject *inv;
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+	int gone;
+	vg_t vg;
+	int rval;
+
+	LVM_VALID();
+
+	if ((inv = PyObject_New(inventoryobject, &LibLVMinventoryType)) == NULL)
+		return NULL;
+	inv->vgs = NULL;
+	inv->vg_count = 0;
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
+	if (!vgnames) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		goto bail;
+	}
+
+	if (!(inv->vgs = calloc(dm_list_size(vgnames) + 1, sizeof(inv_vg_t)))) {
+		PyErr_NoMemory();
+		goto bail;
+	}
+
+	dm_list_iterate_items(strl, vgnames) {
+		Py_BEGIN_ALLOW_THREADS
+		vg = liblvm_vg_open_listed(strl->str, &gone);
+		Py_END_ALLOW_THREADS
+
+		if (!vg && gone)
+			continue;
+		if (!vg) {
+			PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+			goto bail;
+		}
+
+		rval = liblvm_inventory_capture_vg(&inv->vgs[inv->vg_count++], vg);
+		lvm_vg_close(vg);
+		if (rval < 0) {
+			PyErr_NoMemory();
+			goto bail;
+		}
+	}
+	LVM_UNLOCK();
+
+	return (PyObject *)inv;
+
+bail:
+	LVM_UNLOCK();
+	Py_DECREF(inv);
+	return NULL;
+}
+
+/* Open-addressed uuid -> index table */
+typedef struct {
+	const char **keys;
+	size_t *index;
+	size_t mask;
+} uuidmap_t;
+
+static size_t
+liblvm_uuid_hash(const char *uuid)
+{
+	size_t h = 2166136261u;
+
+	while (*uuid)
+		h = (h ^ (unsigned char)*uuid++) * 16777619u;
+
+	return h;
+}
+
+static void
+liblvm_uuidmap_free(uuidmap_t *map)
+{
+	free(map->keys);
+	free(map->index);
+	map->keys = NULL;
+	map->index = NULL;
+}
+
+static int
+liblvm_uuidmap_init(uuidmap_t *map, size_t count)
+{
+	size_t size = 16;
+
+	while (size < count * 2)
+		size <<= 1;
+
+	map->mask = size - 1;
+	map->keys = calloc(size, sizeof(*map->keys));
+	map->index = calloc(size, sizeof(*map->index));
+	if (!map->keys || !map->index) {
+		liblvm_uuidmap_free(map);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+liblvm_uuidmap_add(uuidmap_t *map, const char *uuid, size_t index)
+{
+	size_t slot = liblvm_uuid_hash(uuid) & map->mask;
+
+	while (map->keys[slot])
+		slot = (slot + 1) & map->mask;
+
+	map->keys[slot] = uuid;
+	map->index[slot] = index;
+}
+
+static int
+liblvm_uuidmap_find(uuidmap_t *map, const char *uuid, size_t *index)
+{
+	size_t slot = liblvm_uuid_hash(uuid) & map->mask;
+
+	while (map->keys[slot]) {
+		if (!strcmp(map->keys[slot], uuid)) {
+			*index = map->index[slot];
+			return 1;
+		}
+		slot = (slot + 1) & map->mask;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Appends (change, vg_name, lv_uuid, lv_name, field, old, new) to changes.
+ * lv may be NULL for VG-level changes; old and new are "s" or "K" values
+ * depending on fmt, or None when fmt is NULL.
+ */
+static int
+liblvm_change(PyObject *changes, const char *change, inv_vg_t *vg, inv_lv_t *lv,
+	      const char *field, const char *fmt, ...)
+{
+	PyObject *values;
+	PyObject *record;
+	va_list ap;
+	int rval;
+
+	if (fmt) {
+		va_start(ap, fmt);
+		values = Py_VaBuildValue(fmt, ap);
+		va_end(ap);
+	} else
+		values = Py_BuildValue("(OO)", Py_None, Py_None);
+	if (!values)
+		return -1;
+
+	record = Py_BuildValue("(sszzzOO)", change, vg->name,
+			       lv ? lv->uuid : NULL, lv ? lv->name : NULL, field,
+			       PyTuple_GET_ITEM(values, 0), PyTuple_GET_ITEM(values, 1));
+	Py_DECREF(values);
+	if (!record)
+		return -1;
+
+	rval = PyList_Append(changes, record);
+	Py_DECREF(record);
+
+	return rval;
+}
+
+static int
+liblvm_diff_str(PyObject *changes, inv_vg_t *vg, inv_lv_t *lv, const char *field,
+		const char *old, const char *new)
+{
+	if (!strcmp(old, new))
+		return 0;
+
+	return liblvm_change(changes, lv ? "lv_changed" : "vg_changed", vg, lv,
+			     field, "(ss)", old, new);
+}
+
+static int
+liblvm_diff_int(PyObject *changes, inv_vg_t *vg, inv_lv_t *lv, const char *field,
+		uint64_t old, uint64_t new)
+{
+	if (old == new)
+		return 0;
+
+	return liblvm_change(changes, lv ? "lv_changed" : "vg_changed", vg, lv,
+			     field, "(KK)", (unsigned long long)old,
+			     (unsigned long long)new);
+}
+
+static int
+liblvm_diff_lv(PyObject *changes, inv_vg_t *vg, inv_lv_t *old, inv_lv_t *new)
+{
+	if (liblvm_diff_str(changes, vg, new, "lv_name", old->name, new->name) ||
+	    liblvm_diff_int(changes, vg, new, "lv_size", old->size, new->size) ||
+	    liblvm_diff_str(changes, vg, new, "lv_attr", old->attr, new->attr) ||
+	    liblvm_diff_str(changes, vg, new, "lv_tags", old->tags, new->tags))
+		return -1;
+
+	return 0;
+}
+
+/* Every LV of vg as added or removed */
+static int
+liblvm_diff_all_lvs(PyObject *changes, const char *change, inv_vg_t *vg)
+{
+	size_t i;
+
+	for (i = 0; i < vg->lv_count; i++)
+		if (liblvm_change(changes, change, vg, &vg->lvs[i], NULL, NULL) < 0)
+			return -1;
+
+	return 0;
+}
+
+static int
+liblvm_diff_vg(PyObject *changes, inv_vg_t *old, inv_vg_t *new)
+{
+	uuidmap_t map;
+	char *seen;
+	size_t i, j;
+	int rval = -1;
+
+	/*
+	 * Same seqno means same metadata, LVs in the same order; only the
+	 * activation state in lv_attr and a PV going missing (the partial bit
+	 * of vg_attr) can have moved.
+	 */
+	if (old->seqno == new->seqno && old->lv_count == new->lv_count) {
+		if (liblvm_diff_str(changes, new, NULL, "vg_attr", old->attr, new->attr))
+			return -1;
+		for (i = 0; i < new->lv_count; i++)
+			if (liblvm_diff_str(changes, new, &new->lvs[i], "lv_attr",
+					    old->lvs[i].attr, new->lvs[i].attr))
+				return -1;
+		return 0;
+	}
+
+	if (liblvm_diff_str(changes, new, NULL, "vg_name", old->name, new->name) ||
+	    liblvm_diff_int(changes, new, NULL, "vg_seqno", old->seqno, new->seqno) ||
+	    liblvm_diff_int(changes, new, NULL, "vg_size", old->size, new->size) ||
+	    liblvm_diff_int(changes, new, NULL, "vg_free", old->free, new->free) ||
+	    liblvm_diff_str(changes, new, NULL, "vg_attr", old->attr, new->attr) ||
+	    liblvm_diff_str(changes, new, NULL, "vg_tags", old->tags, new->tags))
+		return -1;
+
+	if (liblvm_uuidmap_init(&map, old->lv_count) < 0) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	if (!(seen = calloc(old->lv_count + 1, 1))) {
+		liblvm_uuidmap_free(&map);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	for (i = 0; i < old->lv_count; i++)
+		liblvm_uuidmap_add(&map, old->lvs[i].uuid, i);
+
+	for (i = 0; i < new->lv_count; i++) {
+		if (!liblvm_uuidmap_find(&map, new->lvs[i].uuid, &j)) {
+			if (liblvm_change(changes, "lv_added", new, &new->lvs[i], NULL, NULL) < 0)
+				goto out;
+			continue;
+		}
+		seen[j] = 1;
+		if (liblvm_diff_lv(changes, new, &old->lvs[j], &new->lvs[i]) < 0)
+			goto out;
+	}
+
+	for (i = 0; i < old->lv_count; i++)
+		if (!seen[i] &&
+		    liblvm_change(changes, "lv_removed", old, &old->lvs[i], NULL, NULL) < 0)
+			goto out;
+
+	rval = 0;
+out:
+	free(seen);
+	liblvm_uuidmap_free(&map);
+	return rval;
+}
+
+static PyObject *
+liblvm_lvm_diff(PyObject *self, PyObject *args)
+{
+	inventoryobject *old;
+	inventoryobject *new;
+	PyObject *changes;
+	uuidmap_t map;
+	char *seen = NULL;
+	size_t i, j;
+
+	if (!PyArg_ParseTuple(args, "O!O!", &LibLVMinventoryType, &old,
+			      &LibLVMinventoryType, &new))
+		return NULL;
+
+	if (!(changes = PyList_New(0)))
+		return NULL;
+
+	if (liblvm_uuidmap_init(&map, old->vg_count) < 0 ||
+	    !(seen = calloc(old->vg_count + 1, 1))) {
+		PyErr_NoMemory();
+		goto bail;
+	}
+
+	for (i = 0; i < old->vg_count; i++)
+		liblvm_uuidmap_add(&map, old->vgs[i].uuid, i);
+
+	for (i = 0; i < new->vg_count; i++) {
+		if (!liblvm_uuidmap_find(&map, new->vgs[i].uuid, &j)) {
+			if (liblvm_change(changes, "vg_added", &new->vgs[i], NULL, NULL, NULL) < 0 ||
+			    liblvm_diff_all_lvs(changes, "lv_added", &new->vgs[i]) < 0)
+				goto bail;
+			continue;
+		}
+		seen[j] = 1;
+		if (liblvm_diff_vg(changes, &old->vgs[j], &new->vgs[i]) < 0)
+			goto bail;
+	}
+
+	for (i = 0; i < old->vg_count; i++)
+		if (!seen[i] &&
+		    (liblvm_change(changes, "vg_removed", &old->vgs[i], NULL, NULL, NULL) < 0 ||
+		     liblvm_diff_all_lvs(changes, "lv_removed", &old->vgs[i]) < 0))
+			goto bail;
+
+	free(seen);
+	liblvm_uuidmap_free(&map);
+
+	return changes;
+
+bail:
+	free(seen);
+	liblvm_uuidmap_free(&map);
+	Py_DECREF(changes);
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * Change notification
+ *
+ * A watch object multiplexes kernel block uevents (a raw netlink socket,
+ * so no libudev dependency) and inotify on the metadata backup and run
+ * directories behind one epoll descriptor, which select/poll/asyncio can
+ * wait on through fileno().  LVM writes <backup_dir>/<vgname> after every
+ * metadata commit, so a "vg" event means that VG's seqno has moved.
+ */
+
+#define LIBLVM_BACKUP_DIR	"/etc/lvm/backup"
+#define LIBLVM_RUN_DIR		"/run/lvm"
+
+#define LIBLVM_INOTIFY_MASK	(IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+
+typedef struct {
+	PyObject_HEAD
+	int epoll_fd;
+	int inotify_fd;
+	int uevent_fd;
+	int backup_wd;
+	int run_wd;
+} watchobject;
+
+static void
+liblvm_watch_close_fds(watchobject *self)
+{
+	if (self->epoll_fd >= 0)
+		close(self->epoll_fd);
+	if (self->inotify_fd >= 0)
+		close(self->inotify_fd);
+	if (self->uevent_fd >= 0)
+		close(self->uevent_fd);
+
+	self->epoll_fd = self->inotify_fd = self->uevent_fd = -1;
+}
+
+static void
+liblvm_watch_dealloc(watchobject *self)
+{
+	liblvm_watch_close_fds(self);
+	PyObject_Del(self);
+}
+
+static int
+liblvm_epoll_add(int epoll_fd, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Missing directories are skipped (-1), anything else is an error (-2) */
+static int
+liblvm_inotify_add_dir(int inotify_fd, const char *dir)
+{
+	int wd;
+
+	if (!dir)
+		return -1;
+
+	if ((wd = inotify_add_watch(inotify_fd, dir, LIBLVM_INOTIFY_MASK)) < 0)
+		return (errno == ENOENT || errno == ENOTDIR) ? -1 : -2;
+
+	return wd;
+}
+
+static int
+liblvm_uevent_open(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	if ((fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			 NETLINK_KOBJECT_UEVENT)) < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* kernel uevents */
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static char *liblvm_watch_kwlist[] = { "backup_dir", "run_dir", "uevents", NULL };
+
+static PyObject *
+liblvm_lvm_watch(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *backup_dir = LIBLVM_BACKUP_DIR;
+	const char *run_dir = LIBLVM_RUN_DIR;
+	int uevents = 1;
+	watchobject *watch;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|zzi", liblvm_watch_kwlist,
+					 &backup_dir, &run_dir, &uevents))
+		return NULL;
+
+	if ((watch = PyObject_New(watchobject, &LibLVMwatchType)) == NULL)
+		return NULL;
+
+	watch->inotify_fd = watch->uevent_fd = -1;
+	watch->backup_wd = watch->run_wd = -1;
+
+	if ((watch->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		goto error;
+
+	if ((watch->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		goto error;
+	if ((watch->backup_wd = liblvm_inotify_add_dir(watch->inotify_fd, backup_dir)) == -2 ||
+	    (watch->run_wd = liblvm_inotify_add_dir(watch->inotify_fd, run_dir)) == -2)
+		goto error;
+	if (liblvm_epoll_add(watch->epoll_fd, watch->inotify_fd) < 0)
+		goto error;
+
+	if (uevents) {
+		if ((watch->uevent_fd = liblvm_uevent_open()) < 0)
+			goto error;
+		if (liblvm_epoll_add(watch->epoll_fd, watch->uevent_fd) < 0)
+			goto error;
+	}
+
+	return (PyObject *)watch;
+
+error:
+	PyErr_SetFromErrno(PyExc_OSError);
+	Py_DECREF(watch);
+	return NULL;
+}
+
+static PyObject *
+liblvm_watch_fileno(watchobject *self)
+{
+	if (self->epoll_fd < 0) {
+		PyErr_SetString(PyExc_ValueError, "watch is closed");
+		return NULL;
+	}
+
+	return Py_BuildValue("i", self->epoll_fd);
+}
+
+static PyObject *
+liblvm_watch_close(watchobject *self)
+{
+	liblvm_watch_close_fds(self);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* Appends ("vg", name) or ("run", name) for each inotify event */
+static int
+liblvm_watch_read_inotify(watchobject *self, PyObject *events)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	PyObject *event;
+	ssize_t len;
+	char *p;
+
+	while ((len = read(self->inotify_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)p;
+
+			/* LVM writes backups to a temporary name and renames */
+			if (!ev->len || ev->name[0] == '.' ||
+			    (ev->wd == self->backup_wd && strstr(ev->name, ".tmp")))
+				continue;
+
+			event = Py_BuildValue("(ss)", ev->wd == self->backup_wd ?
+					      "vg" : "run", ev->name);
+			if (!event || PyList_Append(events, event) < 0) {
+				Py_XDECREF(event);
+				return -1;
+			}
+			Py_DECREF(event);
+		}
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EINTR) {
+		PyErr_SetFromErrno(PyExc_OSError);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Appends ("block"|"dm", action, name) for each block device uevent */
+static int
+liblvm_watch_read_uevents(watchobject *self, PyObject *events)
+{
+	char buf[8192];
+	const char *action, *subsystem, *devname, *dm_name;
+	PyObject *event;
+	ssize_t len;
+	char *p, *at;
+
+	while ((len = recv(self->uevent_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = '\0';
+
+		/* "ACTION@DEVPATH\0KEY=VALUE\0..." */
+		if (!(at = strchr(buf, '@')))
+			continue;
+		*at = '\0';
+		action = buf;
+
+		subsystem = devname = dm_name = NULL;
+		for (p = at + strlen(at + 1) + 2; p < buf + len; p += strlen(p) + 1) {
+			if (!strncmp(p, "SUBSYSTEM=", 10))
+				subsystem = p + 10;
+			else if (!strncmp(p, "DEVNAME=", 8))
+				devname = p + 8;
+			else if (!strncmp(p, "DM_NAME=", 8))
+				dm_name = p + 8;
+		}
+
+		if (!subsystem || strcmp(subsystem, "block") || !devname)
+			continue;
+
+		if (dm_name || !strncmp(devname, "dm-", 3))
+			event = Py_BuildValue("(sss)", "dm", action, dm_name ? dm_name : devname);
+		else
+			event = Py_BuildValue("(sss)", "block", action, devname);
+		if (!event || PyList_Append(events, event) < 0) {
+			Py_XDECREF(event);
+			return -1;
+		}
+		Py_DECREF(event);
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EINTR) {
+		PyErr_SetFromErrno(PyExc_OSError);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Drains whatever is pending without blocking; () if nothing happened */
+static PyObject *
+liblvm_watch_read(watchobject *self)
+{
+	PyObject *events;
+	PyObject *rc;
+
+	if (self->epoll_fd < 0) {
+		PyErr_SetString(PyExc_ValueError, "watch is closed");
+		return NULL;
+	}
+
+	if (!(events = PyList_New(0)))
+		return NULL;
+
+	if (liblvm_watch_read_inotify(self, events) < 0 ||
+	    (self->uevent_fd >= 0 && liblvm_watch_read_uevents(self, events) < 0)) {
+		Py_DECREF(events);
+		return NULL;
+	}
+
+	rc = PyList_AsTuple(events);
+	Py_DECREF(events);
+
+	return rc;
+}
+
+/* Caller holds liblvm_lock */
+static int
+liblvm_vg_read_seqno(const char *vgname, uint64_t *seqno)
+{
+	vg_t vg;
+
+	Py_BEGIN_ALLOW_THREADS
+	vg = lvm_vg_open(libh, vgname, "r", 0);
+	if (vg) {
+		*seqno = lvm_vg_get_seqno(vg);
+		lvm_vg_close(vg);
+	}
+	Py_END_ALLOW_THREADS
+
+	if (!vg) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Is there an inotify event in the backup directory for vgname? */
+static int
+liblvm_inotify_saw_vg(int fd, const char *vgname)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+	int seen = 0;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)p;
+			if (ev->len && !strcmp(ev->name, vgname))
+				seen = 1;
+		}
+
+	return seen;
+}
+
+static char *liblvm_wait_seqno_kwlist[] = { "vgname", "timeout", "backup_dir", NULL };
+
+/*
+ * Blocks until the named VG's seqno moves and returns the new one, or
+ * None on timeout.  Wakes on backups being written; if backups are off
+ * or the directory is missing it falls back to rereading once a second.
+ */
+static PyObject *
+liblvm_lvm_wait_for_seqno_change(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *vgname;
+	PyObject *timeout_arg = Py_None;
+	const char *backup_dir = LIBLVM_BACKUP_DIR;
+	uint64_t seqno, current;
+	int64_t deadline = -1, wait;
+	double timeout;
+	struct pollfd pfd;
+	int fd = -1;
+	int check;
+	int rval;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oz", liblvm_wait_seqno_kwlist,
+					 &vgname, &timeout_arg, &backup_dir))
+		return NULL;
+
+	if (timeout_arg != Py_None) {
+		timeout = PyFloat_AsDouble(timeout_arg);
+		if (timeout == -1.0 && PyErr_Occurred())
+			return NULL;
+		deadline = liblvm_now_ms() + (int64_t)(timeout * 1000);
+	}
+
+	/* watch first, so a commit landing while the seqno is read is seen */
+	LVM_LOCK();
+	if (backup_dir && lvm_config_find_bool(libh, "backup/backup", 1) == 1) {
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd >= 0 && inotify_add_watch(fd, backup_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	rval = liblvm_vg_read_seqno(vgname, &seqno);
+	LVM_UNLOCK();
+	if (rval < 0)
+		goto bail;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		wait = deadline < 0 ? -1 : deadline - liblvm_now_ms();
+		if (deadline >= 0 && wait < 0)
+			wait = 0;
+		if (fd < 0 && (wait < 0 || wait > 1000))
+			wait = 1000;
+
+		Py_BEGIN_ALLOW_THREADS
+		rval = poll(&pfd, fd < 0 ? 0 : 1, (int)wait);
+		Py_END_ALLOW_THREADS
+
+		if (rval < 0 && errno == EINTR) {
+			if (PyErr_CheckSignals() < 0)
+				goto bail;
+			continue;
+		}
+		if (rval < 0) {
+			PyErr_SetFromErrno(PyExc_OSError);
+			goto bail;
+		}
+
+		check = fd < 0 || (rval > 0 && liblvm_inotify_saw_vg(fd, vgname));
+		if (!check && deadline >= 0 && liblvm_now_ms() >= deadline)
+			check = 1;
+
+		if (check) {
+			LVM_LOCK();
+			rval = liblvm_vg_read_seqno(vgname, &current);
+			LVM_UNLOCK();
+			if (rval < 0)
+				goto bail;
+			if (current != seqno) {
+				if (fd >= 0)
+					close(fd);
+				return Py_BuildValue("K", (unsigned long long)current);
+			}
+		}
+
+		if (deadline >= 0 && liblvm_now_ms() >= deadline)
+			break;
+	}
+
+	if (fd >= 0)
+		close(fd);
+	Py_INCREF(Py_None);
+	return Py_None;
+
+bail:
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * Utilization polling
+ *
+ * Thin pool, snapshot and mirror fill levels for every LV of a VG in one
+ * pass.  The *_percent properties are encoded percent_t values; they are
+ * decoded with lvm_percent_to_float() and come back as None where the LV
+ * type has no such figure or it isn't active.
+ */
+
+static const char *liblvm_percent_fields[] = {
+	"data_percent", "metadata_percent", "copy_percent", "snap_percent", NULL
+};
+
+static PyObject *
+liblvm_percent_value(lv_t lv, const char *name)
+{
+	struct lvm_property_value prop = lvm_lv_get_property(lv, name);
+
+	if (!prop.is_valid || !prop.is_integer ||
+	    (percent_t)prop.value.integer == (percent_t)-1) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	return Py_BuildValue("d", (double)lvm_percent_to_float((percent_t)prop.value.integer));
+}
+
+/*
+ * Adds name: (data_percent, metadata_percent, copy_percent, snap_percent)
+ * to util for every LV of vg that has at least one of them.  Caller holds
+ * liblvm_lock.
+ */
+static int
+liblvm_vg_utilization(vg_t vg, PyObject *util)
+{
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	PyObject *values;
+	PyObject *value;
+	int i, any;
+
+	if (!(lvs = lvm_vg_list_lvs(vg)))
+		return 0;
+
+	dm_list_iterate_items(lvl, lvs) {
+		if (!(values = PyTuple_New(4)))
+			return -1;
+
+		for (i = 0, any = 0; liblvm_percent_fields[i]; i++) {
+			if (!(value = liblvm_percent_value(lvl->lv, liblvm_percent_fields[i]))) {
+				Py_DECREF(values);
+				return -1;
+			}
+			any |= value != Py_None;
+			PyTuple_SET_ITEM(values, i, value);
+		}
+
+		if (any && PyDict_SetItemString(util, lvm_lv_get_name(lvl->lv), values) < 0) {
+			Py_DECREF(values);
+			return -1;
+		}
+		Py_DECREF(values);
+	}
+
+	return 0;
+}
+
+static PyObject *
+liblvm_lvm_vg_utilization(vgobject *self)
+{
+	PyObject *util;
+
+	VG_VALID(self);
+
+	if (!(util = PyDict_New())) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	if (liblvm_vg_utilization(self->vg, util) < 0)
+		Py_CLEAR(util);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return util;
+}
+
+/* { vgname: vg.utilization() } for every VG, each opened read-only */
+static PyObject *
+liblvm_lvm_utilization(void)
+{
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+	PyObject *all;
+	PyObject *util;
+	int gone;
+	vg_t vg;
+	int rval;
+
+	LVM_VALID();
+
+	if (!(all = PyDict_New()))
+		return NULL;
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
+	if (!vgnames) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		goto bail;
+	}
+
+	dm_list_iterate_items(strl, vgnames) {
+		Py_BEGIN_ALLOW_THREADS
+		vg = liblvm_vg_open_listed(strl->str, &gone);
+		Py_END_ALLOW_THREADS
+
+		if (!vg && gone)
+			continue;
+		if (!vg) {
+			PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+			goto bail;
+		}
+
+		if (!(util = PyDict_New())) {
+			lvm_vg_close(vg);
+			goto bail;
+		}
+
+		rval = liblvm_vg_utilization(vg, util);
+		lvm_vg_close(vg);
+		if (rval < 0 || PyDict_SetItemString(all, strl->str, util) < 0) {
+			Py_DECREF(util);
+			goto bail;
+		}
+		Py_DECREF(util);
+	}
+	LVM_UNLOCK();
+
+	return all;
+
+bail:
+	LVM_UNLOCK();
+	Py_DECREF(all);
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * Bulk activation state
+ *
+ * lv.isActive() and friends go through LVM and device-mapper once per LV.
+ * Here the dm devices are listed once, only the LVM-owned ones are
+ * queried, and they are mapped back to LVs by their dm uuid, which is
+ * "LVM-" + VG id + LV id (no dashes), optionally followed by a "-layer"
+ * suffix for hidden devices such as thin pool or snapshot internals.
+ */
+
+#define LVM_ID_LEN	32
+#define LVM_DM_PREFIX	"LVM-"
+
+/*
+ * Kernels from 5.14 put each device's event number, flags and uuid after
+ * its name in a DM_DEVICE_LIST reply when libdevmapper asks for uuids.
+ * The values are the kernel's ABI, so they are spelled out for older
+ * headers.
+ */
+#ifndef DM_NAME_LIST_FLAG_HAS_UUID
+#define DM_NAME_LIST_FLAG_HAS_UUID		1
+#define DM_NAME_LIST_FLAG_DOESNT_HAVE_UUID	2
+#endif
+
+typedef struct {
+	char uuid[2 * LVM_ID_LEN + 1];	/* VG id + LV id */
+	int layer;			/* from a "-suffix" device */
+	struct dm_info info;
+} dmdev_t;
+
+/* LVM's dashed uuid as a bare 32 char id */
+static void
+liblvm_strip_uuid(const char *uuid, char *id)
+{
+	int i = 0;
+
+	for (; *uuid && i < LVM_ID_LEN; uuid++)
+		if (*uuid != '-')
+			id[i++] = *uuid;
+	id[i] = '\0';
+}
+
+/* Bare 32 char id to LVM's 6-4-4-4-4-4-6 dashed form */
+static void
+liblvm_format_uuid(const char *id, char *uuid)
+{
+	static const int groups[] = { 6, 4, 4, 4, 4, 4, 6 };
+	int g, i;
+
+	for (g = 0; g < 7; g++) {
+		if (g)
+			*uuid++ = '-';
+		for (i = 0; i < groups[g]; i++)
+			*uuid++ = *id++;
+	}
+	*uuid = '\0';
+}
+
+/*
+ * Device-mapper name prefix of a VG's devices, or of one LV's devices
+ * (its own plus layers such as "-real" or "-tpool"): names are joined
+ * with '-' and have their own dashes doubled.  A truncated prefix is
+ * still a prefix, so it stays usable as a filter.
+ */
+static void
+liblvm_dm_name_prefix(char *buf, size_t size, const char *vgname,
+		      const char *lvname)
+{
+	const char *parts[2] = { vgname, lvname };
+	size_t n = 0;
+	const char *c;
+	int i;
+
+	for (i = 0; i < 2 && parts[i]; i++) {
+		for (c = parts[i]; *c && n + 3 < size; c++) {
+			if (*c == '-')
+				buf[n++] = '-';
+			buf[n++] = *c;
+		}
+		if (i == 0 && n + 1 < size)
+			buf[n++] = '-';
+	}
+	buf[n] = '\0';
+}
+
+/*
+ * LVM names its devices vg-lv (or vg-lv-layer) with the dashes inside
+ * each part doubled, so an LVM device name has at least one single '-'.
+ */
+static int
+liblvm_dm_name_is_lvm(const char *name)
+{
+	for (; *name; name++) {
+		if (*name != '-')
+			continue;
+		if (name[1] != '-')
+			return 1;
+		name++;
+	}
+	return 0;
+}
+
+/*
+ * The uuid a DM_DEVICE_LIST entry carries, "" for a device without one.
+ * NULL when the kernel or libdevmapper didn't report uuids in the list,
+ * and only a DM_DEVICE_INFO can tell.
+ */
+static const char *
+liblvm_dm_listed_uuid(const struct dm_names *names)
+{
+	const uint32_t *event_nr;
+	uintptr_t p = (uintptr_t)(names->name + strlen(names->name) + 1);
+
+	/* the kernel pads the name to 8 bytes before event_nr and flags */
+	event_nr = (const uint32_t *)((p + 7) & ~(uintptr_t)7);
+	if (names->next &&
+	    (const char *)(event_nr + 2) > (const char *)names + names->next)
+		return NULL;
+
+	if (event_nr[1] & DM_NAME_LIST_FLAG_DOESNT_HAVE_UUID)
+		return "";
+	if (!(event_nr[1] & DM_NAME_LIST_FLAG_HAS_UUID))
+		return NULL;
+
+	p = (uintptr_t)(event_nr + 2);
+	return (const char *)((p + 7) & ~(uintptr_t)7);
+}
+
+/*
+ * The part of uuid after LVM_DM_PREFIX if it belongs to an LVM device
+ * whose VG + LV id starts with prefix, else NULL.
+ */
+static const char *
+liblvm_dm_uuid_match(const char *uuid, const char *prefix)
+{
+	if (!uuid || strncmp(uuid, LVM_DM_PREFIX, strlen(LVM_DM_PREFIX)) ||
+	    strlen(uuid) < strlen(LVM_DM_PREFIX) + 2 * LVM_ID_LEN)
+		return NULL;
+
+	uuid += strlen(LVM_DM_PREFIX);
+	return strncmp(uuid, prefix, strlen(prefix)) ? NULL : uuid;
+}
+
+/* By uuid, with a device of the LV itself ahead of its layers */
+static int
+liblvm_dmdev_cmp(const void *a, const void *b)
+{
+	const dmdev_t *x = a, *y = b;
+	int rc = strcmp(x->uuid, y->uuid);
+
+	return rc ? rc : x->layer - y->layer;
+}
+
+/*
+ * Collects every LVM device whose uuid starts with LVM_DM_PREFIX + prefix
+ * (all of them for an empty prefix), sorted for liblvm_dm_device_find().
+ * Only devices that can be LVM's are queried at all: with a name prefix
+ * those named that way, and never names LVM wouldn't give a device.  When
+ * the listing carries uuids, non-LVM devices are dropped before their
+ * DM_DEVICE_INFO too; older kernels and libdevmapper don't list uuids,
+ * so there the name is all there is to go on.
+ * Caller holds liblvm_lock and has released the GIL.  Returns -1 with
+ * *what set to the failing step.
+ */
+static int
+liblvm_dm_devices(const char *prefix, const char *name_prefix,
+		  dmdev_t **devs, size_t *count, const char **what)
+{
+	struct dm_task *dmt;
+	struct dm_task *info;
+	struct dm_names *names;
+	const char *uuid;
+	dmdev_t *dev;
+	dmdev_t *tmp;
+	size_t alloced = 0;
+	unsigned next = 0;
+	int rval = -1;
+
+	*devs = NULL;
+	*count = 0;
+
+	*what = "device list";
+	if (!(dmt = dm_task_create(DM_DEVICE_LIST)))
+		return -1;
+	if (!dm_task_run(dmt) || !(names = dm_task_get_names(dmt)))
+		goto out;
+
+	rval = 0;
+	/* an empty list has dev == 0 */
+	if (!names->dev)
+		goto out;
+
+	do {
+		names = (struct dm_names *)((char *)names + next);
+		next = names->next;
+
+		if (name_prefix &&
+		    strncmp(names->name, name_prefix, strlen(name_prefix)))
+			continue;
+		if (!liblvm_dm_name_is_lvm(names->name))
+			continue;
+		if ((uuid = liblvm_dm_listed_uuid(names)) &&
+		    !liblvm_dm_uuid_match(uuid, prefix))
+			continue;
+
+		if (!(info = dm_task_create(DM_DEVICE_INFO)) ||
+		    !dm_task_set_name(info, names->name) ||
+		    !dm_task_run(info)) {
+			/* removed since the listing */
+			if (info)
+				dm_task_destroy(info);
+			continue;
+		}
+
+		/* the device may have changed since the listing */
+		if (!(uuid = liblvm_dm_uuid_match(dm_task_get_uuid(info), prefix))) {
+			dm_task_destroy(info);
+			continue;
+		}
+
+		if (*count == alloced) {
+			alloced = alloced ? alloced * 2 : 64;
+			if (!(tmp = realloc(*devs, alloced * sizeof(dmdev_t)))) {
+				dm_task_destroy(info);
+				*what = "allocation";
+				rval = -1;
+				goto out;
+			}
+			*devs = tmp;
+		}
+
+		dev = &(*devs)[(*count)++];
+		memcpy(dev->uuid, uuid, 2 * LVM_ID_LEN);
+		dev->uuid[2 * LVM_ID_LEN] = '\0';
+		dev->layer = uuid[2 * LVM_ID_LEN] != '\0';
+		if (!dm_task_get_info(info, &dev->info) || !dev->info.exists)
+			(*count)--;
+		dm_task_destroy(info);
+	} while (next);
+
+out:
+	dm_task_destroy(dmt);
+	if (rval < 0) {
+		free(*devs);
+		*devs = NULL;
+		*count = 0;
+	} else if (*count)
+		qsort(*devs, *count, sizeof(dmdev_t), liblvm_dmdev_cmp);
+	return rval;
+}
+
+/*
+ * The device of id (VG id + LV id): its own, or a layer device if the LV
+ * only exists as those.  NULL when it isn't active.
+ */
+static const dmdev_t *
+liblvm_dm_device_find(const char *id, const dmdev_t *devs, size_t count)
+{
+	size_t lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(devs[mid].uuid, id) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < count && !strcmp(devs[lo].uuid, id) ? &devs[lo] : NULL;
+}
+
+/* (active, suspended, open_count, live_table) from an LV's device */
+static PyObject *
+liblvm_activation_state(const dmdev_t *found)
+{
+	if (!found)
+		return Py_BuildValue("(OOiO)", Py_False, Py_False, 0, Py_False);
+
+	return Py_BuildValue("(OOiO)", Py_True,
+			     found->info.suspended ? Py_True : Py_False,
+			     (int)found->info.open_count,
+			     found->info.live_table ? Py_True : Py_False);
+}
+
+static PyObject *
+liblvm_dm_devices_error(const char *what)
+{
+	PyErr_Format(LibLVMError, "device-mapper %s failed", what);
+	return NULL;
+}
+
+/* { lv_name: (active, suspended, open_count, live_table) } for the VG */
+static PyObject *
+liblvm_lvm_vg_activation_states(vgobject *self)
+{
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	PyObject *states = NULL;
+	PyObject *state;
+	const char *what;
+	dmdev_t *devs;
+	size_t count;
+	char id[2 * LVM_ID_LEN + 1];
+	char name[256];
+	int rval;
+
+	VG_VALID(self);
+
+	LVM_LOCK();
+	liblvm_strip_uuid(lvm_vg_get_uuid(self->vg), id);
+	liblvm_dm_name_prefix(name, sizeof(name), lvm_vg_get_name(self->vg), NULL);
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_dm_devices(id, name, &devs, &count, &what);
+	Py_END_ALLOW_THREADS
+	if (rval < 0) {
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
+		return liblvm_dm_devices_error(what);
+	}
+
+	if (!(states = PyDict_New()))
+		goto out;
+
+	if (!(lvs = lvm_vg_list_lvs(self->vg)))
+		goto out;
+
+	dm_list_iterate_items(lvl, lvs) {
+		liblvm_strip_uuid(lvm_lv_get_uuid(lvl->lv), id + LVM_ID_LEN);
+		if (!(state = liblvm_activation_state(liblvm_dm_device_find(id, devs, count))) ||
+		    PyDict_SetItemString(states, lvm_lv_get_name(lvl->lv), state) < 0) {
+			Py_XDECREF(state);
+			Py_CLEAR(states);
+			goto out;
+		}
+		Py_DECREF(state);
+	}
+
+out:
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	free(devs);
+
+	return states;
+}
+
+/*
+ * { lv_uuid: (active, suspended, open_count, live_table) } for every
+ * active LV on the system, without reading any VG metadata.
+ */
+static PyObject *
+liblvm_lvm_activation_states(void)
+{
+	PyObject *states;
+	PyObject *state;
+	const char *what;
+	dmdev_t *devs;
+	size_t count, i;
+	char uuid[LVM_ID_LEN + 7];
+	int rval;
+
+	LVM_VALID();
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_dm_devices("", NULL, &devs, &count, &what);
+	Py_END_ALLOW_THREADS
+	LVM_UNLOCK();
+	if (rval < 0)
+		return liblvm_dm_devices_error(what);
+
+	if (!(states = PyDict_New()))
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		/* the first device of each LV is the one to report */
+		if (i && !strcmp(devs[i].uuid, devs[i - 1].uuid))
+			continue;
+		liblvm_format_uuid(devs[i].uuid + LVM_ID_LEN, uuid);
+		if (!(state = liblvm_activation_state(&devs[i])) ||
+		    PyDict_SetItemString(states, uuid, state) < 0) {
+			Py_XDECREF(state);
+			Py_CLEAR(states);
+			goto out;
+		}
+		Py_DECREF(state);
+	}
+
+out:
+	free(devs);
+
+	return states;
+}
+
+/* ----------------------------------------------------------------------
+ * I/O statistics
+ *
+ * Counters come from device-mapper stats regions on the LV's device.
+ * Regions are created under our own program id, so they don't collide
+ * with dmstats(8) users, and are left in place between calls so that the
+ * counters accumulate.  The aux data of each region records how it was
+ * laid out ("lv" or "seg", plus the histogram bounds), and regions are
+ * recreated when a caller asks for a different layout.
+ */
+
+#define LIBLVM_STATS_PROGRAM	"python-lvm"
+
+typedef struct {
+	uint64_t start;			/* sectors */
+	uint64_t len;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t read_sectors;
+	uint64_t write_sectors;
+	uint64_t in_flight;
+	uint64_t read_ns;
+	uint64_t write_ns;
+	int nbins;
+	uint64_t *bins;			/* lower, upper, count per bin */
+} iostat_region_t;
+
+typedef struct {
+	char name[128];
+	uint32_t major;
+	uint32_t minor;
+	uint64_t *segs;			/* start, len in sectors per segment */
+	size_t nsegs;
+	iostat_region_t *regions;
+	size_t nregions;
+} iostat_t;
+
+static void
+liblvm_iostat_free(iostat_t *t)
+{
+	size_t i;
+
+	for (i = 0; i < t->nregions; i++)
+		free(t->regions[i].bins);
+	free(t->regions);
+	free(t->segs);
+	t->regions = NULL;
+	t->segs = NULL;
+	t->nregions = 0;
+	t->nsegs = 0;
+}
+
+/* Segment layout of an LV, in sectors; caller holds liblvm_lock */
+static int
+liblvm_iostat_segments(iostat_t *t, vgobject *vgobj, lv_t lv)
+{
+	struct dm_list *segs;
+	struct lvm_lvseg_list *segl;
+	uint64_t start, size;
+	size_t n = 0;
+
+	if (!(segs = lvm_lv_list_lvsegs(lv)) || !dm_list_size(segs))
+		return 0;
+
+	if (!(t->segs = calloc(2 * dm_list_size(segs), sizeof(uint64_t)))) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	dm_list_iterate_items(segl, segs) {
+		if (liblvm_lvseg_get_integer(vgobj, segl->lvseg, "seg_start", &start) < 0 ||
+		    liblvm_lvseg_get_integer(vgobj, segl->lvseg, "seg_size", &size) < 0)
+			return -1;
+		t->segs[2 * n] = start >> 9;
+		t->segs[2 * n + 1] = size >> 9;
+		n++;
+	}
+	t->nsegs = n;
+
+	return 0;
+}
+
+static int
+liblvm_iostat_region_cmp(const void *a, const void *b)
+{
+	const iostat_region_t *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static struct dm_stats *
+liblvm_iostat_bind(iostat_t *t)
+{
+	struct dm_stats *dms;
+
+	if (!(dms = dm_stats_create(LIBLVM_STATS_PROGRAM)))
+		return NULL;
+
+	if (!dm_stats_bind_devno(dms, t->major, t->minor) ||
+	    !dm_stats_list(dms, LIBLVM_STATS_PROGRAM)) {
+		dm_stats_destroy(dms);
+		return NULL;
+	}
+
+	return dms;
+}
+
+/*
+ * Delete every region listed in dms.  The ids are gathered first since
+ * deleting a region while dm_stats_foreach_region() walks the table
+ * would pull entries out from under the cursor.
+ */
+static int
+liblvm_iostat_delete_all(struct dm_stats *dms)
+{
+	uint64_t *ids;
+	uint64_t n = 0, i;
+	int rval = 0;
+
+	if (!dm_stats_get_nr_regions(dms))
+		return 0;
+
+	if (!(ids = malloc(dm_stats_get_nr_regions(dms) * sizeof(*ids))))
+		return -1;
+
+	dm_stats_foreach_region(dms)
+		ids[n++] = dm_stats_get_current_region(dms);
+
+	for (i = 0; i < n; i++)
+		if (!dm_stats_delete_region(dms, ids[i]))
+			rval = -1;
+
+	free(ids);
+	return rval;
+}
+
+/*
+ * Make sure the device carries our regions in the requested layout
+ * (unless create is off) and read their counters.  Called without the
+ * GIL; returns -1 with *what set to the failing step.
+ */
+static int
+liblvm_iostat_collect(iostat_t *t, const char *layout, int segments,
+		      struct dm_histogram *bounds, int create, const char **what)
+{
+	struct dm_stats *dms;
+	iostat_region_t *r;
+	struct dm_histogram *dmh;
+	const char *aux;
+	uint64_t id;
+	uint64_t wanted = segments ? t->nsegs : 1;
+	int stale = 0;
+	int i;
+
+	*what = "stats list";
+	if (!(dms = liblvm_iostat_bind(t)))
+		return -1;
+
+	dm_stats_foreach_region(dms) {
+		aux = dm_stats_get_region_aux_data(dms, dm_stats_get_current_region(dms));
+		if (!aux || strcmp(aux, layout))
+			stale = 1;
+	}
+	if (dm_stats_get_nr_regions(dms) != wanted)
+		stale = 1;
+
+	if (stale && create) {
+		*what = "stats region delete";
+		if (liblvm_iostat_delete_all(dms) < 0)
+			goto bail;
+
+		*what = "stats region create";
+		if (!segments) {
+			/* start and len of 0 cover the whole device */
+			if (!dm_stats_create_region(dms, &id, 0, 0, -1, 0, bounds,
+						    LIBLVM_STATS_PROGRAM, layout))
+				goto bail;
+		} else {
+			for (id = 0; id < t->nsegs; id++) {
+				uint64_t region;
+
+				if (!dm_stats_create_region(dms, &region, t->segs[2 * id],
+							    t->segs[2 * id + 1], -1, 0, bounds,
+							    LIBLVM_STATS_PROGRAM, layout))
+					goto bail;
+			}
+		}
+
+		dm_stats_destroy(dms);
+		*what = "stats list";
+		if (!(dms = liblvm_iostat_bind(t)))
+			return -1;
+	}
+
+	if (!dm_stats_get_nr_regions(dms)) {
+		dm_stats_destroy(dms);
+		return 0;
+	}
+
+	*what = "stats populate";
+	if (!dm_stats_populate(dms, LIBLVM_STATS_PROGRAM, DM_STATS_REGIONS_ALL))
+		goto bail;
+
+	*what = "allocation";
+	if (!(t->regions = calloc(dm_stats_get_nr_regions(dms), sizeof(iostat_region_t))))
+		goto bail;
+
+	dm_stats_foreach_region(dms) {
+		id = dm_stats_get_current_region(dms);
+		r = &t->regions[t->nregions++];
+		dm_stats_get_region_start(dms, &r->start, id);
+		dm_stats_get_region_len(dms, &r->len, id);
+		r->reads = dm_stats_get_reads(dms, id, 0);
+		r->writes = dm_stats_get_writes(dms, id, 0);
+		r->read_sectors = dm_stats_get_read_sectors(dms, id, 0);
+		r->write_sectors = dm_stats_get_write_sectors(dms, id, 0);
+		r->in_flight = dm_stats_get_io_in_progress(dms, id, 0);
+		r->read_ns = dm_stats_get_read_nsecs(dms, id, 0);
+		r->write_ns = dm_stats_get_write_nsecs(dms, id, 0);
+
+		if (!(dmh = dm_stats_get_histogram(dms, id, 0)) ||
+		    (r->nbins = dm_histogram_get_nr_bins(dmh)) <= 0)
+			continue;
+		if (!(r->bins = calloc(3 * r->nbins, sizeof(uint64_t))))
+			goto bail;
+		for (i = 0; i < r->nbins; i++) {
+			r->bins[3 * i] = dm_histogram_get_bin_lower(dmh, i);
+			r->bins[3 * i + 1] = dm_histogram_get_bin_upper(dmh, i);
+			r->bins[3 * i + 2] = dm_histogram_get_bin_count(dmh, i);
+		}
+	}
+
+	qsort(t->regions, t->nregions, sizeof(iostat_region_t),
+	      liblvm_iostat_region_cmp);
+
+	dm_stats_destroy(dms);
+	return 0;
+
+bail:
+	dm_stats_destroy(dms);
+	liblvm_iostat_free(t);
+	return -1;
+}
+
+/*
+ * ((start, length, reads, writes, read_sectors, write_sectors, in_flight,
+ *   read_ns, write_ns, histogram), ...), one entry per region ordered by
+ * start, with start and length in bytes.  histogram is a tuple of
+ * (lower_ns, upper_ns, count) or None.
+ */
+static PyObject *
+liblvm_iostat_to_tuple(iostat_t *t)
+{
+	iostat_region_t *r;
+	PyObject *regions;
+	PyObject *hist;
+	PyObject *item;
+	size_t i;
+	int b;
+
+	if (!(regions = PyTuple_New(t->nregions)))
+		return NULL;
+
+	for (i = 0; i < t->nregions; i++) {
+		r = &t->regions[i];
+
+		if (!r->bins) {
+			Py_INCREF(Py_None);
+			hist = Py_None;
+		} else {
+			if (!(hist = PyTuple_New(r->nbins)))
+				goto bail;
+			for (b = 0; b < r->nbins; b++) {
+				if (!(item = Py_BuildValue("(KKK)",
+							   (unsigned long long)r->bins[3 * b],
+							   (unsigned long long)r->bins[3 * b + 1],
+							   (unsigned long long)r->bins[3 * b + 2]))) {
+					Py_DECREF(hist);
+					goto bail;
+				}
+				PyTuple_SET_ITEM(hist, b, item);
+			}
+		}
+
+		item = Py_BuildValue("(KKKKKKKKKN)",
+				     (unsigned long long)r->start << 9,
+				     (unsigned long long)r->len << 9,
+				     (unsigned long long)r->reads,
+				     (unsigned long long)r->writes,
+				     (unsigned long long)r->read_sectors,
+				     (unsigned long long)r->write_sectors,
+				     (unsigned long long)r->in_flight,
+				     (unsigned long long)r->read_ns,
+				     (unsigned long long)r->write_ns,
+				     hist);
+		if (!item)
+			goto bail;
+		PyTuple_SET_ITEM(regions, i, item);
+	}
+
+	return regions;
+
+bail:
+	Py_DECREF(regions);
+	return NULL;
+}
+
+static char *liblvm_iostats_kwlist[] = { "segments", "histogram", "create", NULL };
+
+/* Layout key stored as the regions' aux data */
+static int
+liblvm_iostats_args(PyObject *args, PyObject *kwds, int *segments,
+		    struct dm_histogram **bounds, int *create,
+		    char *layout, size_t size)
+{
+	PyObject *seg_obj = NULL;
+	PyObject *create_obj = NULL;
+	const char *histogram = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OzO", liblvm_iostats_kwlist,
+					 &seg_obj, &histogram, &create_obj))
+		return -1;
+
+	*segments = seg_obj ? PyObject_IsTrue(seg_obj) : 0;
+	*create = create_obj ? PyObject_IsTrue(create_obj) : 1;
+	*bounds = NULL;
+	if (*segments < 0 || *create < 0)
+		return -1;
+
+	if (histogram && (strchr(histogram, ' ') ||
+			  !(*bounds = dm_histogram_bounds_from_string(histogram)))) {
+		PyErr_Format(PyExc_ValueError, "bad histogram bounds '%s'", histogram);
+		return -1;
+	}
+
+	if ((size_t)snprintf(layout, size, "%s:%s", *segments ? "seg" : "lv",
+			     histogram ? histogram : "") >= size) {
+		if (*bounds)
+			dm_histogram_bounds_destroy(*bounds);
+		PyErr_SetString(PyExc_ValueError, "histogram bounds too long");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Region counters of the LV (see liblvm_iostat_to_tuple), or None when
+ * it isn't active.  With segments=True there is a region per segment;
+ * histogram takes dmstats style bounds such as "1ms,10ms,100ms".
+ */
+static PyObject *
+liblvm_lvm_lv_io_stats(lvobject *self, PyObject *args, PyObject *kwds)
+{
+	struct dm_histogram *bounds;
+	const char *what;
+	char layout[256];
+	char id[2 * LVM_ID_LEN + 1];
+	char name[256];
+	dmdev_t *devs = NULL;
+	const dmdev_t *dev;
+	size_t count;
+	iostat_t t;
+	PyObject *rc = NULL;
+	int segments, create;
+	int rval;
+
+	LV_VALID(self);
+
+	if (liblvm_iostats_args(args, kwds, &segments, &bounds, &create,
+				layout, sizeof(layout)) < 0) {
+		LV_UNLOCK(self);
+		return NULL;
+	}
+
+	memset(&t, 0, sizeof(t));
+
+	LVM_LOCK();
+	liblvm_strip_uuid(lvm_vg_get_uuid(self->parent_vgobj->vg), id);
+	liblvm_strip_uuid(lvm_lv_get_uuid(self->lv), id + LVM_ID_LEN);
+	liblvm_dm_name_prefix(name, sizeof(name), lvm_vg_get_name(self->parent_vgobj->vg),
+			      lvm_lv_get_name(self->lv));
+	if (segments && liblvm_iostat_segments(&t, self->parent_vgobj, self->lv) < 0) {
+		LVM_UNLOCK();
+		LV_UNLOCK(self);
+		goto out;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_dm_devices(id, name, &devs, &count, &what);
+	if (!rval && (dev = liblvm_dm_device_find(id, devs, count)) && !dev->layer) {
+		t.major = dev->info.major;
+		t.minor = dev->info.minor;
+		rval = liblvm_iostat_collect(&t, layout, segments, bounds, create, &what);
+	}
+	Py_END_ALLOW_THREADS
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+
+	if (rval < 0)
+		liblvm_dm_devices_error(what);
+	else if (!t.nregions) {
+		Py_INCREF(Py_None);
+		rc = Py_None;
+	} else
+		rc = liblvm_iostat_to_tuple(&t);
+
+out:
+	if (bounds)
+		dm_histogram_bounds_destroy(bounds);
+	liblvm_iostat_free(&t);
+	free(devs);
+	return rc;
+}
+
+/* Drop the LV's stats regions */
+static PyObject *
+liblvm_lvm_lv_io_stats_remove(lvobject *self)
+{
+	struct dm_stats *dms;
+	const char *what;
+	char id[2 * LVM_ID_LEN + 1];
+	char name[256];
+	dmdev_t *devs = NULL;
+	const dmdev_t *dev;
+	size_t count;
+	iostat_t t;
+	int rval;
+
+	LV_VALID(self);
+
+	memset(&t, 0, sizeof(t));
+
+	LVM_LOCK();
+	liblvm_strip_uuid(lvm_vg_get_uuid(self->parent_vgobj->vg), id);
+	liblvm_strip_uuid(lvm_lv_get_uuid(self->lv), id + LVM_ID_LEN);
+	liblvm_dm_name_prefix(name, sizeof(name), lvm_vg_get_name(self->parent_vgobj->vg),
+			      lvm_lv_get_name(self->lv));
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_dm_devices(id, name, &devs, &count, &what);
+	if (!rval && (dev = liblvm_dm_device_find(id, devs, count)) && !dev->layer) {
+		t.major = dev->info.major;
+		t.minor = dev->info.minor;
+		what = "stats list";
+		if (!(dms = liblvm_iostat_bind(&t)))
+			rval = -1;
+		else {
+			what = "stats region delete";
+			rval = liblvm_iostat_delete_all(dms);
+			dm_stats_destroy(dms);
+		}
+	}
+	Py_END_ALLOW_THREADS
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+	free(devs);
+
+	if (rval < 0)
+		return liblvm_dm_devices_error(what);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/*
+ * { lv_name: regions } for every active LV of the VG in one pass over
+ * the device-mapper devices; arguments as for lv.ioStats().
+ */
+static PyObject *
+liblvm_lvm_vg_io_stats(vgobject *self, PyObject *args, PyObject *kwds)
+{
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	struct dm_histogram *bounds;
+	const char *what;
+	char layout[256];
+	char id[2 * LVM_ID_LEN + 1];
+	char name[256];
+	dmdev_t *devs = NULL;
+	const dmdev_t *dev;
+	iostat_t *stats = NULL;
+	size_t count = 0, nstats = 0, i;
+	PyObject *result = NULL;
+	PyObject *item;
+	int segments, create;
+	int rval = 0;
+
+	VG_VALID(self);
+
+	if (liblvm_iostats_args(args, kwds, &segments, &bounds, &create,
+				layout, sizeof(layout)) < 0) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	liblvm_strip_uuid(lvm_vg_get_uuid(self->vg), id);
+	liblvm_dm_name_prefix(name, sizeof(name), lvm_vg_get_name(self->vg), NULL);
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_dm_devices(id, name, &devs, &count, &what);
+	Py_END_ALLOW_THREADS
+	if (rval < 0) {
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
+		liblvm_dm_devices_error(what);
+		goto out;
+	}
+
+	/* pair the active LVs with their devices */
+	if ((lvs = lvm_vg_list_lvs(self->vg)) && dm_list_size(lvs) &&
+	    !(stats = calloc(dm_list_size(lvs), sizeof(iostat_t)))) {
+		LVM_UNLOCK();
+		VG_UNLOCK(self);
+		PyErr_NoMemory();
+		goto out;
+	}
+
+	if (stats) {
+		dm_list_iterate_items(lvl, lvs) {
+			liblvm_strip_uuid(lvm_lv_get_uuid(lvl->lv), id + LVM_ID_LEN);
+			if (!(dev = liblvm_dm_device_find(id, devs, count)) || dev->layer)
+				continue;
+
+			snprintf(stats[nstats].name, sizeof(stats[nstats].name), "%s",
+				 lvm_lv_get_name(lvl->lv));
+			stats[nstats].major = dev->info.major;
+			stats[nstats].minor = dev->info.minor;
+			if (segments && liblvm_iostat_segments(&stats[nstats], self, lvl->lv) < 0) {
+				nstats++;
+				LVM_UNLOCK();
+				VG_UNLOCK(self);
+				goto out;
+			}
+			nstats++;
+		}
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	for (i = 0; i < nstats; i++)
+		if ((rval = liblvm_iostat_collect(&stats[i], layout, segments,
+						  bounds, create, &what)) < 0)
+			break;
+	Py_END_ALLOW_THREADS
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	if (rval < 0) {
+		liblvm_dm_devices_error(what);
+		goto out;
+	}
+
+	if (!(result = PyDict_New()))
+		goto out;
+
+	for (i = 0; i < nstats; i++) {
+		if (!stats[i].nregions)
+			continue;
+		if (!(item = liblvm_iostat_to_tuple(&stats[i])) ||
+		    PyDict_SetItemString(result, stats[i].name, item) < 0) {
+			Py_XDECREF(item);
+			Py_CLEAR(result);
+			goto out;
+		}
+		Py_DECREF(item);
+	}
+
+out:
+	if (bounds)
+		dm_histogram_bounds_destroy(bounds);
+	for (i = 0; i < nstats; i++)
+		liblvm_iostat_free(&stats[i]);
+	free(stats);
+	free(devs);
+	return result;
+}
+
+/* ----------------------------------------------------------------------
+ * Shared inventory file
+ *
+ * One publisher writes an inventory to a file that any number of local
+ * readers mmap() and query without going near lvm2app.  A new generation
+ * is written to a temporary file and renamed over the old one, so a
+ * reader's mapping never changes under it and refresh() swaps to the new
+ * generation in one step.  The layout is native-endian and only meant for
+ * processes on the same host:
+ *
+ *	header, vg records, lv records, pv records, string area
+ *
+ * Records refer to strings by offset into the string area, and a VG's LVs
+ * and PVs are contiguous runs of records.
+ */
+
+#define LVM_SHINV_MAGIC		"LVMINV\0\1"
+
+typedef struct {
+	char magic[8];
+	uint64_t generation;
+	uint64_t size;			/* of the whole file */
+	uint32_t vg_count;
+	uint32_t lv_count;
+	uint32_t pv_count;
+	uint32_t pad;
+} shinv_hdr_t;
+
+typedef struct {
+	uint32_t uuid;
+	uint32_t name;
+	uint32_t first_lv;
+	uint32_t lv_count;
+	uint32_t first_pv;
+	uint32_t pv_count;
+	uint64_t seqno;
+	uint64_t size;
+	uint64_t free;
+} shinv_vg_t;
+
+typedef struct {
+	uint32_t uuid;
+	uint32_t name;
+	uint32_t attr;
+	uint32_t tags;
+	uint64_t size;
+} shinv_lv_t;
+
+typedef struct {
+	uint32_t uuid;
+	uint32_t name;
+	uint64_t size;
+	uint64_t free;
+} shinv_pv_t;
+
+/* Pointers into a mapped (or about to be written) inventory image */
+typedef struct {
+	shinv_hdr_t *hdr;
+	shinv_vg_t *vgs;
+	shinv_lv_t *lvs;
+	shinv_pv_t *pvs;
+	char *strings;
+	size_t strings_size;
+} shinv_t;
+
+static void
+liblvm_shinv_layout(shinv_t *si, char *image)
+{
+	si->hdr = (shinv_hdr_t *)image;
+	si->vgs = (shinv_vg_t *)(si->hdr + 1);
+	si->lvs = (shinv_lv_t *)(si->vgs + si->hdr->vg_count);
+	si->pvs = (shinv_pv_t *)(si->lvs + si->hdr->lv_count);
+	si->strings = (char *)(si->pvs + si->hdr->pv_count);
+	si->strings_size = si->hdr->size - (si->strings - image);
+}
+
+static uint32_t
+liblvm_shinv_add_str(shinv_t *si, size_t *used, const char *str)
+{
+	uint32_t off = *used;
+	size_t len = strlen(str) + 1;
+
+	memcpy(si->strings + off, str, len);
+	*used += len;
+
+	return off;
+}
+
+/* Flattens inv into a malloc'ed image; the generation is left at 0 */
+static char *
+liblvm_shinv_build(inventoryobject *inv, size_t *size)
+{
+	shinv_hdr_t hdr;
+	shinv_t si;
+	size_t strings = 0;
+	size_t used = 0;
+	size_t i, j, lv = 0, pv = 0;
+	inv_vg_t *ivg;
+	char *image;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LVM_SHINV_MAGIC, sizeof(hdr.magic));
+	hdr.vg_count = inv->vg_count;
+
+	for (i = 0; i < inv->vg_count; i++) {
+		ivg = &inv->vgs[i];
+		hdr.lv_count += ivg->lv_count;
+		hdr.pv_count += ivg->pv_count;
+		strings += strlen(ivg->uuid) + strlen(ivg->name) + 2;
+		for (j = 0; j < ivg->lv_count; j++)
+			strings += strlen(ivg->lvs[j].uuid) + strlen(ivg->lvs[j].name) +
+				strlen(ivg->lvs[j].attr) + strlen(ivg->lvs[j].tags) + 4;
+		for (j = 0; j < ivg->pv_count; j++)
+			strings += strlen(ivg->pvs[j].uuid) + strlen(ivg->pvs[j].name) + 2;
+	}
+
+	hdr.size = sizeof(hdr) + hdr.vg_count * sizeof(shinv_vg_t) +
+		hdr.lv_count * sizeof(shinv_lv_t) +
+		hdr.pv_count * sizeof(shinv_pv_t) + strings;
+	if (strings > UINT32_MAX || !(image = calloc(1, hdr.size)))
+		return NULL;
+
+	memcpy(image, &hdr, sizeof(hdr));
+	liblvm_shinv_layout(&si, image);
+
+	for (i = 0; i < inv->vg_count; i++) {
+		ivg = &inv->vgs[i];
+		si.vgs[i].uuid = liblvm_shinv_add_str(&si, &used, ivg->uuid);
+		si.vgs[i].name = liblvm_shinv_add_str(&si, &used, ivg->name);
+		si.vgs[i].seqno = ivg->seqno;
+		si.vgs[i].size = ivg->size;
+		si.vgs[i].free = ivg->free;
+		si.vgs[i].first_lv = lv;
+		si.vgs[i].lv_count = ivg->lv_count;
+		si.vgs[i].first_pv = pv;
+		si.vgs[i].pv_count = ivg->pv_count;
+
+		for (j = 0; j < ivg->lv_count; j++, lv++) {
+			si.lvs[lv].uuid = liblvm_shinv_add_str(&si, &used, ivg->lvs[j].uuid);
+			si.lvs[lv].name = liblvm_shinv_add_str(&si, &used, ivg->lvs[j].name);
+			si.lvs[lv].attr = liblvm_shinv_add_str(&si, &used, ivg->lvs[j].attr);
+			si.lvs[lv].tags = liblvm_shinv_add_str(&si, &used, ivg->lvs[j].tags);
+			si.lvs[lv].size = ivg->lvs[j].size;
+		}
+
+		for (j = 0; j < ivg->pv_count; j++, pv++) {
+			si.pvs[pv].uuid = liblvm_shinv_add_str(&si, &used, ivg->pvs[j].uuid);
+			si.pvs[pv].name = liblvm_shinv_add_str(&si, &used, ivg->pvs[j].name);
+			si.pvs[pv].size = ivg->pvs[j].size;
+			si.pvs[pv].free = ivg->pvs[j].free;
+		}
+	}
+
+	*size = hdr.size;
+	return image;
+}
+
+/* Checks that every offset and count in a mapped image stays inside it */
+static int
+liblvm_shinv_check(const char *image, size_t size)
+{
+	const shinv_hdr_t *hdr = (const shinv_hdr_t *)image;
+	shinv_t si;
+	uint64_t records;
+	uint32_t i, j;
+
+	if (size < sizeof(*hdr) || memcmp(hdr->magic, LVM_SHINV_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->size != size)
+		return -1;
+
+	records = sizeof(*hdr) + (uint64_t)hdr->vg_count * sizeof(shinv_vg_t) +
+		(uint64_t)hdr->lv_count * sizeof(shinv_lv_t) +
+		(uint64_t)hdr->pv_count * sizeof(shinv_pv_t);
+	if (records >= size || image[size - 1] != '\0')
+		return -1;
+
+	liblvm_shinv_layout(&si, (char *)image);
+
+	for (i = 0; i < hdr->vg_count; i++) {
+		if (si.vgs[i].uuid >= si.strings_size || si.vgs[i].name >= si.strings_size ||
+		    si.vgs[i].first_lv > hdr->lv_count ||
+		    si.vgs[i].lv_count > hdr->lv_count - si.vgs[i].first_lv ||
+		    si.vgs[i].first_pv > hdr->pv_count ||
+		    si.vgs[i].pv_count > hdr->pv_count - si.vgs[i].first_pv)
+			return -1;
+	}
+	for (j = 0; j < hdr->lv_count; j++) {
+		if (si.lvs[j].uuid >= si.strings_size || si.lvs[j].name >= si.strings_size ||
+		    si.lvs[j].attr >= si.strings_size || si.lvs[j].tags >= si.strings_size)
+			return -1;
+	}
+	for (j = 0; j < hdr->pv_count; j++) {
+		if (si.pvs[j].uuid >= si.strings_size || si.pvs[j].name >= si.strings_size)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Generation of the inventory at path, or 0 if there is none.  *same is
+ * set if its contents match image.  Called without the GIL.
+ */
+static uint64_t
+liblvm_shinv_current(const char *path, const char *image, size_t size, int *same)
+{
+	shinv_hdr_t hdr;
+	uint64_t generation = 0;
+	char *old;
+	int fd;
+
+	*same = 0;
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    memcmp(hdr.magic, LVM_SHINV_MAGIC, sizeof(hdr.magic)))
+		goto out;
+
+	generation = hdr.generation;
+	if (hdr.size != size || !(old = malloc(size - sizeof(hdr))))
+		goto out;
+
+	if (read(fd, old, size - sizeof(hdr)) == (ssize_t)(size - sizeof(hdr)))
+		*same = !memcmp(old, image + sizeof(hdr), size - sizeof(hdr));
+	free(old);
+
+out:
+	close(fd);
+	return generation;
+}
+
+static int
+liblvm_write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes image to path as the next generation unless it matches the
+ * current one.  Returns the generation now published, 0 with errno set
+ * on failure.  Called without the GIL.
+ */
+static uint64_t
+liblvm_shinv_publish(const char *path, char *image, size_t size)
+{
+	shinv_hdr_t *hdr = (shinv_hdr_t *)image;
+	char *tmp;
+	int same;
+	int fd;
+	int err;
+
+	hdr->generation = liblvm_shinv_current(path, image, size, &same);
+	if (same)
+		return hdr->generation;
+	hdr->generation++;
+
+	if (!(tmp = malloc(strlen(path) + 32))) {
+		errno = ENOMEM;
+		return 0;
+	}
+	sprintf(tmp, "%s.%ld.tmp", path, (long)getpid());
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		goto fail;
+
+	if (liblvm_write_all(fd, image, size) < 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		goto unlink;
+	}
+
+	if (close(fd) < 0 || rename(tmp, path) < 0)
+		goto unlink;
+
+	free(tmp);
+	return hdr->generation;
+
+unlink:
+	err = errno;
+	unlink(tmp);
+	errno = err;
+fail:
+	free(tmp);
+	return 0;
+}
+
+static char *liblvm_publish_kwlist[] = { "path", "inventory", NULL };
+
+/*
+ * Publishes inventory, or a fresh lvm.inventory() if None, to path for
+ * lvm.inventoryReader().  Nothing is written if it matches what is already
+ * there.  Returns the published generation.  Meant for a single publisher
+ * per path, typically driven by lvm.watch().
+ */
+static PyObject *
+liblvm_lvm_publish_inventory(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	const char *path;
+	PyObject *inv = NULL;
+	uint64_t generation;
+	char *image;
+	size_t size;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|O", liblvm_publish_kwlist,
+					 &path, &inv))
+		return NULL;
+
+	if (inv && inv != Py_None) {
+		if (!PyObject_TypeCheck(inv, &LibLVMinventoryType)) {
+			PyErr_Format(PyExc_TypeError, "inventory must come from lvm.inventory()");
+			return NULL;
+		}
+		Py_INCREF(inv);
+	} else if (!(inv = liblvm_lvm_inventory())) {
+		return NULL;
+	}
+
+	image = liblvm_shinv_build((inventoryobject *)inv, &size);
+	Py_DECREF(inv);
+	if (!image)
+		return PyErr_NoMemory();
+
+	Py_BEGIN_ALLOW_THREADS
+	generation = liblvm_shinv_publish(path, image, size);
+	Py_END_ALLOW_THREADS
+	free(image);
+
+	if (!generation)
+		return PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+
+	return Py_BuildValue("K", (unsigned long long)generation);
+}
+
+typedef struct {
+	PyObject_HEAD
+	char *path;
+	char *image;		/* mapping of the current generation */
+	size_t size;
+	dev_t dev;
+	ino_t ino;
+	shinv_t si;
+} invreaderobject;
+
+static void
+liblvm_invreader_unmap(invreaderobject *self)
+{
+	if (self->image)
+		munmap(self->image, self->size);
+	self->image = NULL;
+	self->size = 0;
+}
+
+static void
+liblvm_invreader_dealloc(invreaderobject *self)
+{
+	liblvm_invreader_unmap(self);
+	free(self->path);
+	PyObject_Del(self);
+}
+
+/*
+ * Maps whatever generation is at path now, if it isn't the one already
+ * mapped.  Returns 1 if it swapped, 0 if not, -1 with an exception set.
+ */
+static int
+liblvm_invreader_map(invreaderobject *self)
+{
+	struct stat st;
+	char *image = MAP_FAILED;
+	int fd;
+	int err = 0;
+	int bad = 0;
+	int unchanged = 0;
+
+	Py_BEGIN_ALLOW_THREADS
+	if ((fd = open(self->path, O_RDONLY | O_CLOEXEC)) < 0) {
+		err = errno;
+	} else {
+		if (fstat(fd, &st) < 0)
+			err = errno;
+		else if (self->image && st.st_dev == self->dev && st.st_ino == self->ino)
+			unchanged = 1;
+		else if (st.st_size < (off_t)sizeof(shinv_hdr_t))
+			bad = 1;
+		else if ((image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+			err = errno;
+		else if (liblvm_shinv_check(image, st.st_size) < 0) {
+			munmap(image, st.st_size);
+			image = MAP_FAILED;
+			bad = 1;
+		}
+		close(fd);
+	}
+	Py_END_ALLOW_THREADS
+
+	if (err) {
+		errno = err;
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, self->path);
+		return -1;
+	}
+
+	if (unchanged)
+		return 0;
+
+	if (bad) {
+		PyErr_Format(PyExc_ValueError, "%s is not an LVM inventory", self->path);
+		return -1;
+	}
+
+	liblvm_invreader_unmap(self);
+	self->image = image;
+	self->size = st.st_size;
+	self->dev = st.st_dev;
+	self->ino = st.st_ino;
+	liblvm_shinv_layout(&self->si, image);
+
+	return 1;
+}
+
+static PyObject *
+liblvm_lvm_inventory_reader(PyObject *self, PyObject *args)
+{
+	invreaderobject *reader;
+	const char *path;
+
+	if (!PyArg_ParseTuple(args, "s", &path))
+		return NULL;
+
+	if ((reader = PyObject_New(invreaderobject, &LibLVMinvreaderType)) == NULL)
+		return NULL;
+	reader->image = NULL;
+	reader->size = 0;
+
+	if (!(reader->path = strdup(path))) {
+		Py_DECREF(reader);
+		return PyErr_NoMemory();
+	}
+
+	if (liblvm_invreader_map(reader) < 0) {
+		Py_DECREF(reader);
+		return NULL;
+	}
+
+	return (PyObject *)reader;
+}
+
+#define INVREADER_VALID(reader)						\
+	do {								\
+		if (!(reader)->image) {					\
+			PyErr_SetString(PyExc_ValueError, "inventory reader is closed"); \
+			return NULL;					\
+		}							\
+	} while (0)
+
+/* Switches to the latest published generation; True if there was one */
+static PyObject *
+liblvm_invreader_refresh(invreaderobject *self)
+{
+	int rval;
+
+	INVREADER_VALID(self);
+
+	if ((rval = liblvm_invreader_map(self)) < 0)
+		return NULL;
+
+	return PyBool_FromLong(rval);
+}
+
+static PyObject *
+liblvm_invreader_generation(invreaderobject *self)
+{
+	INVREADER_VALID(self);
+
+	return Py_BuildValue("K", (unsigned long long)self->si.hdr->generation);
+}
+
+static PyObject *
+liblvm_invreader_close(invreaderobject *self)
+{
+	liblvm_invreader_unmap(self);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static shinv_vg_t *
+liblvm_invreader_find_vg(invreaderobject *self, const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < self->si.hdr->vg_count; i++)
+		if (!strcmp(self->si.strings + self->si.vgs[i].name, name))
+			return &self->si.vgs[i];
+
+	PyErr_SetString(PyExc_KeyError, name);
+	return NULL;
+}
+
+static PyObject *
+liblvm_invreader_list_vg_names(invreaderobject *self)
+{
+	PyObject *pytuple;
+	PyObject *name;
+	uint32_t i;
+
+	INVREADER_VALID(self);
+
+	if (!(pytuple = PyTuple_New(self->si.hdr->vg_count)))
+		return NULL;
+
+	for (i = 0; i < self->si.hdr->vg_count; i++) {
+		if (!(name = PyString_FromString(self->si.strings + self->si.vgs[i].name))) {
+			Py_DECREF(pytuple);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(pytuple, i, name);
+	}
+
+	return pytuple;
+}
+
+/* (uuid, name, seqno, size, free) */
+static PyObject *
+liblvm_invreader_get_vg(invreaderobject *self, PyObject *args)
+{
+	const char *name;
+	shinv_vg_t *vg;
+
+	INVREADER_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+
+	if (!(vg = liblvm_invreader_find_vg(self, name)))
+		return NULL;
+
+	return Py_BuildValue("(ssKKK)", self->si.strings + vg->uuid,
+			     self->si.strings + vg->name,
+			     (unsigned long long)vg->seqno,
+			     (unsigned long long)vg->size,
+			     (unsigned long long)vg->free);
+}
+
+/* ((uuid, name, size, attr, tags), ...) */
+static PyObject *
+liblvm_invreader_list_lvs(invreaderobject *self, PyObject *args)
+{
+	const char *name;
+	shinv_vg_t *vg;
+	shinv_lv_t *lv;
+	PyObject *pytuple;
+	PyObject *item;
+	uint32_t i;
+
+	INVREADER_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+
+	if (!(vg = liblvm_invreader_find_vg(self, name)))
+		return NULL;
+
+	if (!(pytuple = PyTuple_New(vg->lv_count)))
+		return NULL;
+
+	for (i = 0; i < vg->lv_count; i++) {
+		lv = &self->si.lvs[vg->first_lv + i];
+		if (!(item = Py_BuildValue("(ssKss)", self->si.strings + lv->uuid,
+					   self->si.strings + lv->name,
+					   (unsigned long long)lv->size,
+					   self->si.strings + lv->attr,
+					   self->si.strings + lv->tags))) {
+			Py_DECREF(pytuple);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(pytuple, i, item);
+	}
+
+	return pytuple;
+}
+
+/* ((uuid, name, size, free), ...) */
+static PyObject *
+liblvm_invreader_list_pvs(invreaderobject *self, PyObject *args)
+{
+	const char *name;
+	shinv_vg_t *vg;
+	shinv_pv_t *pv;
+	PyObject *pytuple;
+	PyObject *item;
+	uint32_t i;
+
+	INVREADER_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+
+	if (!(vg = liblvm_invreader_find_vg(self, name)))
+		return NULL;
+
+	if (!(pytuple = PyTuple_New(vg->pv_count)))
+		return NULL;
+
+	for (i = 0; i < vg->pv_count; i++) {
+		pv = &self->si.pvs[vg->first_pv + i];
+		if (!(item = Py_BuildValue("(ssKK)", self->si.strings + pv->uuid,
+					   self->si.strings + pv->name,
+					   (unsigned long long)pv->size,
+					   (unsigned long long)pv->free))) {
+			Py_DECREF(pytuple);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(pytuple, i, item);
+	}
+
+	return pytuple;
+}
+
+/* ----------------------------------------------------------------------
+ * Query broker
+ *
+ * lvm.brokerServe() lets one process own the library handle and answer
+ * read-only queries for the others over a Unix socket, so they don't each
+ * scan devices and take VG locks.  Requests that arrive together are
+ * coalesced: each distinct request in a batch goes to lvm2app once and the
+ * answer is sent to every client that asked.  lvm.brokerConnect() is the
+ * client side; its queries return the same shapes as lvm.inventoryReader().
+ * It does not mirror the vgobject/lvobject API: it hands out plain tuples,
+ * not objects with getName()/getSize()/getProperty()/listLVs(), and offers
+ * no writes.  Those need VG locks held across calls, which a broker shared
+ * between clients can't hold for any one of them.
+ *
+ * The protocol is line based.  A request is "verb[ vgname]\n"; the reply
+ * is "OK <len>\n" or "ERR <len>\n" followed by len bytes of payload, one
+ * record per line with tab-separated fields (LVM names, uuids, attributes
+ * and tags can't contain either).  An error payload is "errno\tmessage".
+ */
+
+#define BROKER_MAX_CLIENTS	256
+#define BROKER_LINE_MAX		512
+
+typedef struct {
+	int fd;
+	char in[BROKER_LINE_MAX];
+	size_t in_len;
+	size_t line_len;	/* of a complete request in in[], 0 if none */
+} broker_client_t;
+
+static void
+outbuf_put_field(outbuf_t *out, const char *str, char sep)
+{
+	outbuf_put(out, str, strlen(str));
+	outbuf_putc(out, sep);
+}
+
+static void
+outbuf_put_ufield(outbuf_t *out, uint64_t value, char sep)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+	outbuf_put_field(out, buf, sep);
+}
+
+static int
+liblvm_broker_error(outbuf_t *out, int err, const char *msg)
+{
+	out->len = 0;
+	out->error = 0;
+	outbuf_put_ufield(out, err, '\t');
+	outbuf_put(out, msg, strlen(msg));
+
+	return -1;
+}
+
+/*
+ * Answers one request into out; returns -1 with an error payload in out.
+ * Caller holds liblvm_lock and has released the GIL.
+ */
+static int
+liblvm_broker_query(const char *request, outbuf_t *out)
+{
+	struct dm_list *list;
+	struct lvm_str_list *strl;
+	struct lvm_lv_list *lvl;
+	struct lvm_pv_list *pvl;
+	const char *vgname;
+	vg_t vg;
+
+	if (!strcmp(request, "listVgNames")) {
+		if (!(list = lvm_list_vg_names(libh)))
+			return liblvm_broker_error(out, lvm_errno(libh), lvm_errmsg(libh));
+		dm_list_iterate_items(strl, list)
+			outbuf_put_field(out, strl->str, '\n');
+		return 0;
+	}
+
+	if (!(vgname = strchr(request, ' ')) ||
+	    (strncmp(request, "getVg ", 6) && strncmp(request, "listLvs ", 8) &&
+	     strncmp(request, "listPvs ", 8)))
+		return liblvm_broker_error(out, EINVAL, "unknown request");
+	vgname++;
+
+	if (!(vg = lvm_vg_open(libh, vgname, "r", 0)))
+		return liblvm_broker_error(out, lvm_errno(libh), lvm_errmsg(libh));
+
+	if (request[0] == 'g') {
+		outbuf_put_field(out, lvm_vg_get_uuid(vg), '\t');
+		outbuf_put_field(out, lvm_vg_get_name(vg), '\t');
+		outbuf_put_ufield(out, lvm_vg_get_seqno(vg), '\t');
+		outbuf_put_ufield(out, lvm_vg_get_size(vg), '\t');
+		outbuf_put_ufield(out, lvm_vg_get_free_size(vg), '\n');
+	} else if (request[4] == 'L') {
+		if ((list = lvm_vg_list_lvs(vg))) {
+			dm_list_iterate_items(lvl, list) {
+				struct lvm_property_value attr = lvm_lv_get_property(lvl->lv, "lv_attr");
+				struct lvm_property_value tags = lvm_lv_get_property(lvl->lv, "lv_tags");
+
+				outbuf_put_field(out, lvm_lv_get_uuid(lvl->lv), '\t');
+				outbuf_put_field(out, lvm_lv_get_name(lvl->lv), '\t');
+				outbuf_put_ufield(out, lvm_lv_get_size(lvl->lv), '\t');
+				outbuf_put_field(out, attr.is_valid && attr.is_string &&
+						 attr.value.string ? attr.value.string : "", '\t');
+				outbuf_put_field(out, tags.is_valid && tags.is_string &&
+						 tags.value.string ? tags.value.string : "", '\n');
+			}
+		}
+	} else {
+		if ((list = lvm_vg_list_pvs(vg))) {
+			dm_list_iterate_items(pvl, list) {
+				outbuf_put_field(out, lvm_pv_get_uuid(pvl->pv), '\t');
+				outbuf_put_field(out, lvm_pv_get_name(pvl->pv), '\t');
+				outbuf_put_ufield(out, lvm_pv_get_size(pvl->pv), '\t');
+				outbuf_put_ufield(out, lvm_pv_get_free(pvl->pv), '\n');
+			}
+		}
+	}
+	lvm_vg_close(vg);
+
+	if (out->error)
+		return liblvm_broker_error(out, out->error, strerror(out->error));
+
+	return 0;
+}
+
+static int
+liblvm_send_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		if ((n = send(fd, buf, len, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int
+liblvm_broker_reply(int fd, int failed, const outbuf_t *out)
+{
+	char header[32];
+
+	snprintf(header, sizeof(header), "%s %zu\n", failed ? "ERR" : "OK", out->len);
+
+	if (liblvm_send_all(fd, header, strlen(header)) < 0 ||
+	    liblvm_send_all(fd, out->data ? out->data : "", out->len) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void
+liblvm_broker_drop(broker_client_t *clients, size_t *count, size_t i)
+{
+	close(clients[i].fd);
+	clients[i] = clients[--*count];
+}
+
+/* Marks a complete request line in c->in, if there is one */
+static void
+liblvm_broker_scan_line(broker_client_t *c)
+{
+	char *nl = memchr(c->in, '\n', c->in_len);
+
+	if (nl) {
+		*nl = '\0';
+		c->line_len = nl - c->in + 1;
+	}
+}
+
+/*
+ * Polls the listening socket and clients for up to timeout ms, accepting
+ * and reading whatever is ready.  Called without the GIL.  Returns the
+ * number of clients with a complete request, -1 with errno on failure.
+ */
+static int
+liblvm_broker_poll(int listen_fd, broker_client_t *clients, size_t *count,
+		   int timeout)
+{
+	struct pollfd fds[BROKER_MAX_CLIENTS + 1];
+	size_t i, n = *count;
+	ssize_t len;
+	int fd;
+	int ready = 0;
+
+	fds[0].fd = listen_fd;
+	fds[0].events = POLLIN;
+	for (i = 0; i < n; i++) {
+		fds[i + 1].fd = clients[i].fd;
+		/* one request per client and batch */
+		fds[i + 1].events = clients[i].line_len ? 0 : POLLIN;
+	}
+
+	if (poll(fds, n + 1, timeout) < 0)
+		return errno == EINTR ? 0 : -1;
+
+	/* walk backwards so dropping a client doesn't skip one */
+	for (i = n; i-- > 0; ) {
+		broker_client_t *c = &clients[i];
+
+		if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		len = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+		if (len <= 0) {
+			if (len < 0 && errno == EINTR)
+				continue;
+			liblvm_broker_drop(clients, count, i);
+			continue;
+		}
+		c->in_len += len;
+		liblvm_broker_scan_line(c);
+
+		/* a request that doesn't fit is not one of ours */
+		if (!c->line_len && c->in_len == sizeof(c->in))
+			liblvm_broker_drop(clients, count, i);
+	}
+
+	if ((fds[0].revents & POLLIN) && *count < BROKER_MAX_CLIENTS &&
+	    (fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		clients[*count].fd = fd;
+		clients[*count].in_len = 0;
+		clients[*count].line_len = 0;
+		(*count)++;
+	}
+
+	for (i = 0; i < *count; i++)
+		ready += clients[i].line_len != 0;
+
+	return ready;
+}
+
+/*
+ * Answers every pending request, each distinct one once.  Caller holds
+ * liblvm_lock and has released the GIL.
+ */
+static void
+liblvm_broker_serve_batch(broker_client_t *clients, size_t *count)
+{
+	outbuf_t out;
+	size_t i, j;
+	int failed;
+
+	memset(&out, 0, sizeof(out));
+	out.fd = -1;
+
+	for (i = 0; i < *count; i++) {
+		if (!clients[i].line_len)
+			continue;
+
+		out.len = 0;
+		out.error = 0;
+		failed = liblvm_broker_query(clients[i].in, &out) < 0;
+
+		/* everyone else in the batch asking the same thing */
+		for (j = *count; j-- > i; ) {
+			broker_client_t *c = &clients[j];
+
+			if (!c->line_len || strcmp(c->in, clients[i].in))
+				continue;
+
+			if (liblvm_broker_reply(c->fd, failed, &out) < 0) {
+				c->line_len = 0;
+				c->in_len = 0;
+				close(c->fd);
+				c->fd = -1;
+				continue;
+			}
+
+			c->in_len -= c->line_len;
+			memmove(c->in, c->in + c->line_len, c->in_len);
+			c->line_len = 0;
+		}
+	}
+	free(out.data);
+
+	/* drop the clients that failed, pick up pipelined requests */
+	for (i = *count; i-- > 0; ) {
+		if (clients[i].fd < 0)
+			clients[i] = clients[--*count];
+		else
+			liblvm_broker_scan_line(&clients[i]);
+	}
+}
+
+static char *liblvm_broker_serve_kwlist[] = { "path", "batch_ms", "mode", NULL };
+
+/*
+ * Removes what an earlier broker left at path.  Anything but a socket, or
+ * a socket somebody still answers on, is left alone and fails with EEXIST
+ * or EADDRINUSE.  Returns -1 with errno set.
+ */
+static int
+liblvm_broker_unlink_stale(const char *path, const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd;
+	int rval;
+
+	if (lstat(path, &st) < 0)
+		return errno == ENOENT ? 0 : -1;
+
+	if (!S_ISSOCK(st.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+	rval = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	close(fd);
+	if (!rval) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+
+	return unlink(path) < 0 && errno != ENOENT ? -1 : 0;
+}
+
+/*
+ * Serves queries on a Unix socket at path until interrupted by a signal
+ * (the exception from the signal handler, e.g. KeyboardInterrupt, is
+ * raised).  After the first request of a batch arrives, the broker waits
+ * up to batch_ms for more before going to lvm2app.  The socket gets
+ * permissions mode (0600, owner only, by default) before it accepts
+ * anyone.
+ */
+static PyObject *
+liblvm_lvm_broker_serve(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	struct sockaddr_un addr;
+	broker_client_t *clients;
+	const char *path;
+	size_t count = 0;
+	size_t i;
+	int batch_ms = 2;
+	int mode = 0600;
+	int listen_fd = -1;
+	int ready;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|ii", liblvm_broker_serve_kwlist,
+					 &path, &batch_ms, &mode))
+		return NULL;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		PyErr_Format(PyExc_ValueError, "socket path too long");
+		return NULL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (!(clients = calloc(BROKER_MAX_CLIENTS, sizeof(*clients))))
+		return PyErr_NoMemory();
+
+	if (liblvm_broker_unlink_stale(path, &addr) < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+		goto out;
+	}
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+		goto out;
+	}
+
+	/* nobody can connect before listen(), so the mode is in place first */
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+		close(listen_fd);
+		listen_fd = -1;
+		goto out;
+	}
+	if (chmod(path, mode) < 0 || listen(listen_fd, 64) < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+		goto out;
+	}
+
+	for (;;) {
+		Py_BEGIN_ALLOW_THREADS
+		ready = liblvm_broker_poll(listen_fd, clients, &count, 500);
+		/* let the rest of the batch come in */
+		if (ready > 0 && batch_ms > 0)
+			ready = liblvm_broker_poll(listen_fd, clients, &count, batch_ms);
+		Py_END_ALLOW_THREADS
+
+		if (ready < 0) {
+			PyErr_SetFromErrno(PyExc_OSError);
+			break;
+		}
+
+		if (PyErr_CheckSignals() < 0)
+			break;
+
+		if (!ready)
+			continue;
+
+		LVM_LOCK();
+		Py_BEGIN_ALLOW_THREADS
+		liblvm_broker_serve_batch(clients, &count);
+		Py_END_ALLOW_THREADS
+		LVM_UNLOCK();
+	}
+
+out:
+	for (i = 0; i < count; i++)
+		close(clients[i].fd);
+	free(clients);
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(path);
+	}
+
+	return NULL;
+}
+
+typedef struct {
+	PyObject_HEAD
+	int fd;
+} brokerobject;
+
+static void
+liblvm_broker_dealloc(brokerobject *self)
+{
+	if (self->fd >= 0)
+		close(self->fd);
+	PyObject_Del(self);
+}
+
+static PyObject *
+liblvm_lvm_broker_connect(PyObject *self, PyObject *args)
+{
+	struct sockaddr_un addr;
+	brokerobject *broker;
+	const char *path;
+	int rval;
+
+	if (!PyArg_ParseTuple(args, "s", &path))
+		return NULL;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		PyErr_Format(PyExc_ValueError, "socket path too long");
+		return NULL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((broker = PyObject_New(brokerobject, &LibLVMbrokerType)) == NULL)
+		return NULL;
+
+	if ((broker->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		Py_DECREF(broker);
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	rval = connect(broker->fd, (struct sockaddr *)&addr, sizeof(addr));
+	Py_END_ALLOW_THREADS
+	if (rval < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *)path);
+		Py_DECREF(broker);
+		return NULL;
+	}
+
+	return (PyObject *)broker;
+}
+
+static int
+liblvm_recv_all(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		if ((n = recv(fd, buf, len, 0)) <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n == 0)
+				errno = ECONNRESET;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Sends request and reads the reply payload into a malloc'ed,
+ * NUL-terminated buffer.  Called without the GIL.  Returns -1 with errno
+ * on I/O failure, otherwise 0 with *failed set for an ERR reply.
+ */
+static int
+liblvm_broker_roundtrip(int fd, const char *request, char **payload,
+			size_t *len, int *failed)
+{
+	char header[32];
+	size_t i;
+
+	if (liblvm_send_all(fd, request, strlen(request)) < 0)
+		return -1;
+
+	for (i = 0; i < sizeof(header) - 1; i++) {
+		if (liblvm_recv_all(fd, &header[i], 1) < 0)
+			return -1;
+		if (header[i] == '\n')
+			break;
+	}
+	header[i] = '\0';
+
+	if (!strncmp(header, "OK ", 3))
+		*failed = 0;
+	else if (!strncmp(header, "ERR ", 4))
+		*failed = 1;
+	else {
+		errno = EPROTO;
+		return -1;
+	}
+
+	*len = strtoull(strchr(header, ' ') + 1, NULL, 10);
+	if (!(*payload = malloc(*len + 1)))
+		return -1;
+
+	if (liblvm_recv_all(fd, *payload, *len) < 0) {
+		free(*payload);
+		return -1;
+	}
+	(*payload)[*len] = '\0';
+
+	return 0;
+}
+
+/*
+ * Record payload to a tuple of tuples, field types as in spec ('s' string,
+ * 'K' unsigned integer).  A one-letter spec gives a tuple of plain values.
+ */
+static PyObject *
+liblvm_broker_parse(char *payload, const char *spec)
+{
+	PyObject *records;
+	PyObject *record;
+	PyObject *value;
+	size_t nfields = strlen(spec);
+	size_t f;
+	char *line, *next, *field, *end;
+
+	if (!(records = PyList_New(0)))
+		return NULL;
+
+	for (line = payload; *line; line = next) {
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if (!(record = PyTuple_New(nfields)))
+			goto bail;
+
+		for (f = 0, field = line; f < nfields; f++) {
+			if ((end = strchr(field, '\t')))
+				*end = '\0';
+
+			if (spec[f] == 'K')
+				value = PyLong_FromUnsignedLongLong(strtoull(field, NULL, 10));
+			else
+				value = PyString_FromString(field);
+			if (!value) {
+				Py_DECREF(record);
+				goto bail;
+			}
+			PyTuple_SET_ITEM(record, f, value);
+
+			field = end ? end + 1 : field + strlen(field);
+		}
+
+		if (nfields == 1) {
+			value = PyTuple_GET_ITEM(record, 0);
+			Py_INCREF(value);
+			Py_DECREF(record);
+			record = value;
+		}
+
+		if (PyList_Append(records, record) < 0) {
+			Py_DECREF(record);
+			goto bail;
+		}
+		Py_DECREF(record);
+	}
+
+	value = PyList_AsTuple(records);
+	Py_DECREF(records);
+	return value;
+
+bail:
+	Py_DECREF(records);
+	return NULL;
+}
+
+static PyObject *
+liblvm_broker_call(brokerobject *self, const char *verb, const char *vgname,
+		   const char *spec)
+{
+	PyObject *rval;
+	PyObject *info;
+	char *request;
+	char *payload;
+	char *msg;
+	size_t len;
+	int failed;
+	int err;
+
+	if (self->fd < 0) {
+		PyErr_SetString(PyExc_ValueError, "broker connection is closed");
+		return NULL;
+	}
+
+	if (vgname && strpbrk(vgname, " \t\n")) {
+		PyErr_Format(PyExc_ValueError, "invalid VG name");
+		return NULL;
+	}
+
+	if (!(request = malloc(strlen(verb) + (vgname ? strlen(vgname) : 0) + 3)))
+		return PyErr_NoMemory();
+	sprintf(request, vgname ? "%s %s\n" : "%s\n", verb, vgname);
+
+	Py_BEGIN_ALLOW_THREADS
+	err = liblvm_broker_roundtrip(self->fd, request, &payload, &len, &failed);
+	Py_END_ALLOW_THREADS
+	free(request);
+
+	if (err < 0)
+		return PyErr_SetFromErrno(PyExc_OSError);
+
+	if (failed) {
+		msg = strchr(payload, '\t');
+		if ((info = Py_BuildValue("(is)", atoi(payload), msg ? msg + 1 : payload))) {
+			PyErr_SetObject(LibLVMError, info);
+			Py_DECREF(info);
+		}
+		free(payload);
+		return NULL;
+	}
+
+	rval = liblvm_broker_parse(payload, spec);
+	free(payload);
+
+	return rval;
+}
+
+static PyObject *
+liblvm_broker_list_vg_names(brokerobject *self)
+{
+	return liblvm_broker_call(self, "listVgNames", NULL, "s");
+}
+
+/* (uuid, name, seqno, size, free) */
+static PyObject *
+liblvm_broker_get_vg(brokerobject *self, PyObject *args)
+{
+	const char *vgname;
+	PyObject *records;
+	PyObject *rval;
+
+	if (!PyArg_ParseTuple(args, "s", &vgname))
+		return NULL;
+
+	if (!(records = liblvm_broker_call(self, "getVg", vgname, "ssKKK")))
+		return NULL;
+
+	if (PyTuple_GET_SIZE(records) != 1) {
+		Py_DECREF(records);
+		PyErr_SetString(PyExc_KeyError, vgname);
+		return NULL;
+	}
+
+	rval = PyTuple_GET_ITEM(records, 0);
+	Py_INCREF(rval);
+	Py_DECREF(records);
+
+	return rval;
+}
+
+/* ((uuid, name, size, attr, tags), ...) */
+static PyObject *
+liblvm_broker_list_lvs(brokerobject *self, PyObject *args)
+{
+	const char *vgname;
+
+	if (!PyArg_ParseTuple(args, "s", &vgname))
+		return NULL;
+
+	return liblvm_broker_call(self, "listLvs", vgname, "ssKss");
+}
+
+/* ((uuid, name, size, free), ...) */
+static PyObject *
+liblvm_broker_list_pvs(brokerobject *self, PyObject *args)
+{
+	const char *vgname;
+
+	if (!PyArg_ParseTuple(args, "s", &vgname))
+		return NULL;
+
+	return liblvm_broker_call(self, "listPvs", vgname, "ssKK");
+}
+
+static PyObject *
+liblvm_broker_close(brokerobject *self)
+{
+	if (self->fd >= 0)
+		close(self->fd);
+	self->fd = -1;
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* ----------------------------------------------------------------------
+ * Tag index
+ *
+ * An inverted index from tag to the VGs and LVs carrying it, built by one
+ * scan on first use and kept up to date by the binding's own writes: a
+ * VG's entries are refreshed whenever vg.addTag() or vg.removeTag() write
+ * it, which also picks up lv.addTag()/removeTag() made since, and remove()
+ * drops them.  Changes made by other processes show up after
+ * lvm.rebuildTagIndex().  Protected by liblvm_lock.
+ */
+
+#define TAGINDEX_BUCKETS	1024
+
+typedef struct tagref {
+	struct tagref *next;
+	char *tag;
+	char *vg;
+	char *lv;		/* NULL for a VG tag */
+} tagref_t;
+
+static tagref_t *liblvm_tags[TAGINDEX_BUCKETS];
+static int liblvm_tags_built;
+
+static tagref_t **
+liblvm_tagindex_bucket(const char *tag)
+{
+	return &liblvm_tags[liblvm_uuid_hash(tag) % TAGINDEX_BUCKETS];
+}
+
+static int
+liblvm_tagref_is(const tagref_t *ref, const char *vg, const char *lv)
+{
+	return !strcmp(ref->vg, vg) &&
+		(lv ? ref->lv && !strcmp(ref->lv, lv) : !ref->lv);
+}
+
+static void
+liblvm_tagref_free(tagref_t *ref)
+{
+	free(ref->tag);
+	free(ref->vg);
+	free(ref->lv);
+	free(ref);
+}
+
+static void
+liblvm_tagindex_clear(void)
+{
+	tagref_t *ref;
+	size_t i;
+
+	for (i = 0; i < TAGINDEX_BUCKETS; i++) {
+		while ((ref = liblvm_tags[i])) {
+			liblvm_tags[i] = ref->next;
+			liblvm_tagref_free(ref);
+		}
+	}
+	liblvm_tags_built = 0;
+}
+
+/* Returns -1 if out of memory */
+static int
+liblvm_tagindex_insert(const char *vg, const char *lv, const char *tag)
+{
+	tagref_t **bucket = liblvm_tagindex_bucket(tag);
+	tagref_t *ref;
+
+	for (ref = *bucket; ref; ref = ref->next)
+		if (!strcmp(ref->tag, tag) && liblvm_tagref_is(ref, vg, lv))
+			return 0;
+
+	if (!(ref = calloc(1, sizeof(*ref))) || !(ref->tag = strdup(tag)) ||
+	    !(ref->vg = strdup(vg)) || (lv && !(ref->lv = strdup(lv)))) {
+		if (ref)
+			liblvm_tagref_free(ref);
+		return -1;
+	}
+
+	ref->next = *bucket;
+	*bucket = ref;
+
+	return 0;
+}
+
+/* Forgets an LV, or with lv NULL a VG and all of its LVs */
+static void
+liblvm_tagindex_drop(const char *vg, const char *lv)
+{
+	tagref_t **prev;
+	tagref_t *ref;
+	size_t i;
+
+	for (i = 0; i < TAGINDEX_BUCKETS; i++) {
+		for (prev = &liblvm_tags[i]; (ref = *prev); ) {
+			if (!strcmp(ref->vg, vg) &&
+			    (!lv || (ref->lv && !strcmp(ref->lv, lv)))) {
+				*prev = ref->next;
+				liblvm_tagref_free(ref);
+			} else {
+				prev = &ref->next;
+			}
+		}
+	}
+}
+
+static int
+liblvm_tagindex_insert_list(const char *vg, const char *lv, struct dm_list *tags)
+{
+	struct lvm_str_list *strl;
+
+	if (!tags)
+		return 0;
+
+	dm_list_iterate_items(strl, tags)
+		if (liblvm_tagindex_insert(vg, lv, strl->str) < 0)
+			return -1;
+
+	return 0;
+}
+
+/* Indexes a VG's own tags and those of its LVs; -1 if out of memory */
+static int
+liblvm_tagindex_insert_vg(vg_t vg)
+{
+	const char *name = lvm_vg_get_name(vg);
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+
+	if (liblvm_tagindex_insert_list(name, NULL, lvm_vg_get_tags(vg)) < 0)
+		return -1;
+
+	if ((lvs = lvm_vg_list_lvs(vg))) {
+		dm_list_iterate_items(lvl, lvs) {
+			if (liblvm_tagindex_insert_list(name, lvm_lv_get_name(lvl->lv),
+							lvm_lv_get_tags(lvl->lv)) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Re-reads a VG's entries from a handle that was just written */
+static void
+liblvm_tagindex_refresh(vg_t vg)
+{
+	if (!liblvm_tags_built)
+		return;
+
+	liblvm_tagindex_drop(lvm_vg_get_name(vg), NULL);
+	/* an index we can't keep complete is no use, start over next time */
+	if (liblvm_tagindex_insert_vg(vg) < 0)
+		liblvm_tagindex_clear();
+}
+
+/*
+ * Indexes the tags of every VG and LV.  Caller holds liblvm_lock and has
+ * released the GIL.  Returns -1 if listing or opening a VG failed, -2 if
+ * out of memory; either way the index is left unbuilt.
+ */
+static int
+liblvm_tagindex_build(void)
+{
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+	int gone;
+	int rval;
+	vg_t vg;
+
+	liblvm_tagindex_clear();
+
+	if (!(vgnames = lvm_list_vg_names(libh)))
+		return -1;
+
+	dm_list_iterate_items(strl, vgnames) {
+		if (!(vg = liblvm_vg_open_listed(strl->str, &gone))) {
+			if (gone)
+				continue;
+			liblvm_tagindex_clear();
+			return -1;
+		}
+
+		rval = liblvm_tagindex_insert_vg(vg);
+		lvm_vg_close(vg);
+
+		if (rval < 0) {
+			liblvm_tagindex_clear();
+			return -2;
+		}
+	}
+
+	liblvm_tags_built = 1;
+	return 0;
+}
+
+/* Caller holds liblvm_lock */
+static int
+liblvm_tagindex_ensure(int rebuild)
+{
+	int rval;
+
+	if (liblvm_tags_built && !rebuild)
+		return 0;
+
+	Py_BEGIN_ALLOW_THREADS
+	rval = liblvm_tagindex_build();
+	Py_END_ALLOW_THREADS
+
+	if (rval == -1)
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	else if (rval < 0)
+		PyErr_NoMemory();
+
+	return rval;
+}
+
+/* Names of the VGs (lv is 0) or (vgname, lvname) of the LVs tagged tag */
+static PyObject *
+liblvm_tagindex_find(PyObject *args, int lv)
+{
+	const char *tag;
+	PyObject *found;
+	PyObject *item;
+	tagref_t *ref;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTuple(args, "s", &tag))
+		return NULL;
+
+	if (!(found = PyList_New(0)))
+		return NULL;
+
+	LVM_LOCK();
+	if (liblvm_tagindex_ensure(0) < 0)
+		goto bail;
+
+	for (ref = *liblvm_tagindex_bucket(tag); ref; ref = ref->next) {
+		if (strcmp(ref->tag, tag) || !ref->lv != !lv)
+			continue;
+
+		if (lv)
+			item = Py_BuildValue("(ss)", ref->vg, ref->lv);
+		else
+			item = PyString_FromString(ref->vg);
+		if (!item || PyList_Append(found, item) < 0) {
+			Py_XDECREF(item);
+			goto bail;
+		}
+		Py_DECREF(item);
+	}
+	LVM_UNLOCK();
+
+	item = PyList_AsTuple(found);
+	Py_DECREF(found);
+	return item;
+
+bail:
+	LVM_UNLOCK();
+	Py_DECREF(found);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_find_vgs_by_tag(PyObject *self, PyObject *args)
+{
+	return liblvm_tagindex_find(args, 0);
+}
+
+static PyObject *
+liblvm_lvm_find_lvs_by_tag(PyObject *self, PyObject *args)
+{
+	return liblvm_tagindex_find(args, 1);
+}
+
+static PyObject *
+liblvm_lvm_rebuild_tag_index(void)
+{
+	int rval;
+
+	LVM_VALID();
+
+	LVM_LOCK();
+	rval = liblvm_tagindex_ensure(1);
+	LVM_UNLOCK();
+
+	if (rval < 0)
+		return NULL;
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* ----------------------------------------------------------------------
+ * Filter expressions
+ *
+ * Selectors such as
+ *
+ *	lv_size > 100G and segtype == "thin" and tag:backup
+ *
+ * are compiled once into a small tree and evaluated against lvm2app
+ * property values, so only the matching LVs or PVs get Python objects.
+ * Fields are LVM report field names; values are numbers with an optional
+ * k/m/g/t/p/e (binary) suffix, or strings, quoted or bare.  Operators are
+ * == != < <= > >=, =~ and !~ for extended regexes, tag:NAME for tag
+ * membership, and and/or/not with parentheses.  Field names are checked
+ * when the filter is compiled; a field without a value compares false.
+ * Segment fields such as segtype or stripes match an LV if any of its
+ * segments matches, and pvseg_* fields a PV likewise.
+ */
+
+enum { FN_AND, FN_OR, FN_NOT, FN_CMP, FN_TAG };
+enum { FOP_EQ, FOP_NE, FOP_LT, FOP_LE, FOP_GT, FOP_GE, FOP_RE, FOP_NRE };
+
+typedef struct fnode {
+	int kind;
+	struct fnode *left;
+	struct fnode *right;
+	char *field;
+	int seg;		/* field of the segments, not the object */
+	int op;
+	char *str;		/* value as written, or the tag */
+	int is_num;
+	uint64_t num;
+	int has_re;
+	regex_t re;
+} fnode_t;
+
+typedef struct lvm_property_value (*fgetter_t)(void *obj, const char *name);
+
+/* What a filter can see of one kind of object */
+typedef struct {
+	const char *const *fields;
+	const char *const *seg_fields;
+	fgetter_t get;
+	int (*any_seg)(struct fnode *n, void *obj);
+	const char *tags_field;
+} fschema_t;
+
+typedef struct {
+	const char *p;
+	const char *error;
+	const fschema_t *schema;
+} fparser_t;
+
+static const char *const liblvm_lv_fields[] = {
+	"lv_uuid", "lv_name", "lv_full_name", "lv_path", "lv_dm_path",
+	"lv_parent", "lv_layout", "lv_role", "lv_initial_image_sync",
+	"lv_image_synced", "lv_merging", "lv_converting",
+	"lv_allocation_policy", "lv_allocation_locked", "lv_fixed_minor",
+	"lv_skip_activation", "lv_when_full", "lv_active", "lv_active_locally",
+	"lv_active_remotely", "lv_active_exclusively", "lv_major", "lv_minor",
+	"lv_read_ahead", "lv_size", "lv_metadata_size", "seg_count", "origin",
+	"origin_uuid", "origin_size", "lv_ancestors", "lv_descendants",
+	"data_percent", "snap_percent", "metadata_percent", "copy_percent",
+	"sync_percent", "raid_mismatch_count", "raid_sync_action",
+	"raid_write_behind", "raid_min_recovery_rate", "raid_max_recovery_rate",
+	"move_pv", "move_pv_uuid", "convert_lv", "convert_lv_uuid",
+	"mirror_log", "mirror_log_uuid", "data_lv", "data_lv_uuid",
+	"metadata_lv", "metadata_lv_uuid", "pool_lv", "pool_lv_uuid",
+	"lv_tags", "lv_profile", "lv_lockargs", "lv_time", "lv_host",
+	"lv_modules", "lv_kernel_major", "lv_kernel_minor",
+	"lv_kernel_read_ahead", "lv_permissions", "lv_suspended",
+	"lv_live_table", "lv_inactive_table", "lv_device_open", "lv_attr",
+	"lv_health_status", "lv_check_needed", "cache_total_blocks",
+	"cache_used_blocks", "cache_dirty_blocks", "cache_read_hits",
+	"cache_read_misses", "cache_write_hits", "cache_write_misses",
+	"kernel_discards", "modules", NULL
+};
+
+static const char *const liblvm_lvseg_fields[] = {
+	"segtype", "stripes", "stripe_size", "stripesize", "region_size",
+	"regionsize", "chunk_size", "chunksize", "thin_count", "discards",
+	"cache_mode", "zero", "transaction_id", "thin_id", "seg_start",
+	"seg_start_pe", "seg_size", "seg_size_pe", "seg_tags", "seg_pe_ranges",
+	"seg_le_ranges", "seg_metadata_le_ranges", "devices",
+	"metadata_devices", "seg_monitor", "cache_policy", "cache_settings",
+	NULL
+};
+
+static const char *const liblvm_pv_fields[] = {
+	"pv_fmt", "pv_uuid", "dev_size", "pv_name", "pv_mda_free",
+	"pv_mda_size", "pe_start", "pv_size", "pv_free", "pv_used", "pv_attr",
+	"pv_allocatable", "pv_exported", "pv_missing", "pv_pe_count",
+	"pv_pe_alloc_count", "pv_tags", "pv_mda_count", "pv_mda_used_count",
+	"pv_ba_start", "pv_ba_size", "pv_in_use", "pv_duplicate", NULL
+};
+
+static const char *const liblvm_pvseg_fields[] = {
+	"pvseg_start", "pvseg_size", NULL
+};
+
+static void
+liblvm_filter_free(fnode_t *n)
+{
+	if (!n)
+		return;
+
+	liblvm_filter_free(n->left);
+	liblvm_filter_free(n->right);
+	free(n->field);
+	free(n->str);
+	if (n->has_re)
+		regfree(&n->re);
+	free(n);
+}
+
+static fnode_t *
+liblvm_filter_node(fparser_t *ps, int kind)
+{
+	fnode_t *n;
+
+	if (!(n = calloc(1, sizeof(*n))))
+		ps->error = "out of memory";
+	else
+		n->kind = kind;
+
+	return n;
+}
+
+static void
+liblvm_filter_skip(fparser_t *ps)
+{
+	while (isspace((unsigned char)*ps->p))
+		ps->p++;
+}
+
+static int
+liblvm_filter_isword(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.' ||
+		c == '+' || c == '/';
+}
+
+/* Consumes keyword (and, or, not) if it comes next */
+static int
+liblvm_filter_keyword(fparser_t *ps, const char *keyword)
+{
+	size_t len = strlen(keyword);
+
+	liblvm_filter_skip(ps);
+	if (strncasecmp(ps->p, keyword, len) || liblvm_filter_isword(ps->p[len]))
+		return 0;
+
+	ps->p += len;
+	return 1;
+}
+
+/* A bare word, which may also contain extra, or a quoted string; malloc'ed */
+static char *
+liblvm_filter_word(fparser_t *ps, const char *extra)
+{
+	const char *start;
+	char quote;
+	char *word;
+	size_t len;
+
+	liblvm_filter_skip(ps);
+
+	if (*ps->p == '"' || *ps->p == '\'') {
+		quote = *ps->p++;
+		start = ps->p;
+		while (*ps->p && *ps->p != quote)
+			ps->p++;
+		if (!*ps->p) {
+			ps->error = "unterminated string";
+			return NULL;
+		}
+		len = ps->p++ - start;
+	} else {
+		start = ps->p;
+		while (liblvm_filter_isword(*ps->p) || (*ps->p && strchr(extra, *ps->p)))
+			ps->p++;
+		if (!(len = ps->p - start)) {
+			ps->error = "value expected";
+			return NULL;
+		}
+	}
+
+	if (!(word = strndup(start, len)))
+		ps->error = "out of memory";
+
+	return word;
+}
+
+/* Parses str as a size, 1.5G and the like; 0 if it isn't a number */
+static int
+liblvm_filter_number(const char *str, uint64_t *num)
+{
+	static const char units[] = "bkmgtpe";
+	const char *unit;
+	double value;
+	char *end;
+
+	if (!isdigit((unsigned char)*str))
+		return 0;
+
+	value = strtod(str, &end);
+	if (*end) {
+		if (!(unit = strchr(units, tolower((unsigned char)*end))))
+			return 0;
+		value *= (double)(1ULL << (10 * (unit - units)));
+		end++;
+		/* 10GiB, 10GB */
+		if (*end == 'i' || *end == 'I')
+			end++;
+		if ((*end == 'b' || *end == 'B') && unit != units)
+			end++;
+		if (*end)
+			return 0;
+	}
+
+	*num = (uint64_t)value;
+	return 1;
+}
+
+static fnode_t *liblvm_filter_or(fparser_t *ps);
+
+static int
+liblvm_filter_known(const char *const *fields, const char *name)
+{
+	for (; fields && *fields; fields++)
+		if (!strcmp(*fields, name))
+			return 1;
+
+	return 0;
+}
+
+static fnode_t *
+liblvm_filter_primary(fparser_t *ps)
+{
+	static const struct { const char *text; int op; } ops[] = {
+		{ "==", FOP_EQ }, { "!=", FOP_NE }, { "<=", FOP_LE }, { ">=", FOP_GE },
+		{ "=~", FOP_RE }, { "!~", FOP_NRE }, { "<", FOP_LT }, { ">", FOP_GT },
+		{ "=", FOP_EQ },
+	};
+	const char *field;
+	fnode_t *n;
+	size_t i;
+
+	liblvm_filter_skip(ps);
+
+	if (*ps->p == '(') {
+		ps->p++;
+		if (!(n = liblvm_filter_or(ps)))
+			return NULL;
+		liblvm_filter_skip(ps);
+		if (*ps->p != ')') {
+			ps->error = "')' expected";
+			liblvm_filter_free(n);
+			return NULL;
+		}
+		ps->p++;
+		return n;
+	}
+
+	if (!strncmp(ps->p, "tag:", 4)) {
+		ps->p += 4;
+		if (!(n = liblvm_filter_node(ps, FN_TAG)))
+			return NULL;
+		/* the other characters LVM allows in tags */
+		if (!(n->str = liblvm_filter_word(ps, "=:!&#"))) {
+			liblvm_filter_free(n);
+			return NULL;
+		}
+		return n;
+	}
+
+	if (!(n = liblvm_filter_node(ps, FN_CMP)))
+		return NULL;
+
+	liblvm_filter_skip(ps);
+	field = ps->p;
+	if (!(n->field = liblvm_filter_word(ps, "")))
+		goto bail;
+
+	if (liblvm_filter_known(ps->schema->seg_fields, n->field)) {
+		n->seg = 1;
+	} else if (!liblvm_filter_known(ps->schema->fields, n->field)) {
+		ps->p = field;
+		ps->error = "unknown field";
+		goto bail;
+	}
+
+	liblvm_filter_skip(ps);
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (!strncmp(ps->p, ops[i].text, strlen(ops[i].text))) {
+			n->op = ops[i].op;
+			ps->p += strlen(ops[i].text);
+			break;
+		}
+	}
+	if (i == sizeof(ops) / sizeof(ops[0])) {
+		ps->error = "comparison operator expected";
+		goto bail;
+	}
+
+	/* bare regexes */
+	if (!(n->str = liblvm_filter_word(ps, "^$*?[]{}|\\")))
+		goto bail;
+
+	if (n->op == FOP_RE || n->op == FOP_NRE) {
+		if (regcomp(&n->re, n->str, REG_EXTENDED | REG_NOSUB)) {
+			ps->error = "invalid regular expression";
+			goto bail;
+		}
+		n->has_re = 1;
+	} else {
+		n->is_num = liblvm_filter_number(n->str, &n->num);
+	}
+
+	return n;
+
+bail:
+	liblvm_filter_free(n);
+	return NULL;
+}
+
+static fnode_t *
+liblvm_filter_not(fparser_t *ps)
+{
+	fnode_t *n;
+
+	if (!liblvm_filter_keyword(ps, "not"))
+		return liblvm_filter_primary(ps);
+
+	if (!(n = liblvm_filter_node(ps, FN_NOT)))
+		return NULL;
+	if (!(n->left = liblvm_filter_not(ps))) {
+		liblvm_filter_free(n);
+		return NULL;
+	}
+
+	return n;
+}
+
+/* Left-associative chain of sub-expressions joined by keyword */
+static fnode_t *
+liblvm_filter_chain(fparser_t *ps, const char *keyword, int kind,
+		    fnode_t *(*sub)(fparser_t *))
+{
+	fnode_t *left;
+	fnode_t *n;
+
+	if (!(left = sub(ps)))
+		return NULL;
+
+	while (liblvm_filter_keyword(ps, keyword)) {
+		if (!(n = liblvm_filter_node(ps, kind))) {
+			liblvm_filter_free(left);
+			return NULL;
+		}
+		n->left = left;
+		left = n;
+		if (!(n->right = sub(ps))) {
+			liblvm_filter_free(left);
+			return NULL;
+		}
+	}
+
+	return left;
+}
+
+static fnode_t *
+liblvm_filter_and(fparser_t *ps)
+{
+	return liblvm_filter_chain(ps, "and", FN_AND, liblvm_filter_not);
+}
+
+static fnode_t *
+liblvm_filter_or(fparser_t *ps)
+{
+	return liblvm_filter_chain(ps, "or", FN_OR, liblvm_filter_and);
+}
+
+static fnode_t *
+liblvm_filter_compile(const char *expr, const fschema_t *schema)
+{
+	fparser_t ps = { expr, NULL, schema };
+	fnode_t *n;
+
+	if ((n = liblvm_filter_or(&ps))) {
+		liblvm_filter_skip(&ps);
+		if (*ps.p) {
+			ps.error = "unexpected text";
+			liblvm_filter_free(n);
+			n = NULL;
+		}
+	}
+
+	if (!n)
+		PyErr_Format(PyExc_ValueError, "bad filter at offset %d: %s",
+			     (int)(ps.p - expr), ps.error ? ps.error : "syntax error");
+
+	return n;
+}
+
+static int
+liblvm_filter_has_tag(const char *tags, const char *tag)
+{
+	size_t len = strlen(tag);
+	const char *p = tags;
+
+	while (p && *p) {
+		if (!strncmp(p, tag, len) && (p[len] == ',' || !p[len]))
+			return 1;
+		if ((p = strchr(p, ',')))
+			p++;
+	}
+
+	return 0;
+}
+
+static int
+liblvm_filter_cmp(fnode_t *n, void *obj, fgetter_t get)
+{
+	struct lvm_property_value prop;
+	char buf[24];
+	const char *str;
+	int cmp;
+
+	prop = get(obj, n->field);
+	if (!prop.is_valid)
+		return 0;
+
+	if (prop.is_integer && n->is_num) {
+		cmp = prop.value.integer < n->num ? -1 : prop.value.integer > n->num;
+	} else {
+		if (prop.is_integer) {
+			snprintf(buf, sizeof(buf), "%llu", (unsigned long long)prop.value.integer);
+			str = buf;
+		} else {
+			str = prop.value.string ? prop.value.string : "";
+		}
+
+		if (n->has_re)
+			return (regexec(&n->re, str, 0, NULL, 0) == 0) == (n->op == FOP_RE);
+
+		cmp = strcmp(str, n->str);
+	}
+
+	switch (n->op) {
+	case FOP_EQ: return cmp == 0;
+	case FOP_NE: return cmp != 0;
+	case FOP_LT: return cmp < 0;
+	case FOP_LE: return cmp <= 0;
+	case FOP_GT: return cmp > 0;
+	case FOP_GE: return cmp >= 0;
+	}
+
+	return 0;
+}
+
+/* Caller holds liblvm_lock */
+static int
+liblvm_filter_eval(fnode_t *n, void *obj, const fschema_t *schema)
+{
+	struct lvm_property_value prop;
+
+	switch (n->kind) {
+	case FN_AND:
+		return liblvm_filter_eval(n->left, obj, schema) &&
+			liblvm_filter_eval(n->right, obj, schema);
+	case FN_OR:
+		return liblvm_filter_eval(n->left, obj, schema) ||
+			liblvm_filter_eval(n->right, obj, schema);
+	case FN_NOT:
+		return !liblvm_filter_eval(n->left, obj, schema);
+	case FN_TAG:
+		prop = schema->get(obj, schema->tags_field);
+		return prop.is_valid && prop.is_string &&
+			liblvm_filter_has_tag(prop.value.string, n->str);
+	}
+
+	return n->seg ? schema->any_seg(n, obj) : liblvm_filter_cmp(n, obj, schema->get);
+}
+
+static struct lvm_property_value
+liblvm_filter_lv_property(void *lv, const char *name)
+{
+	return lvm_lv_get_property((lv_t)lv, name);
+}
+
+static struct lvm_property_value
+liblvm_filter_lvseg_property(void *lvseg, const char *name)
+{
+	return lvm_lvseg_get_property((lvseg_t)lvseg, name);
+}
+
+static int
+liblvm_filter_any_lvseg(fnode_t *n, void *lv)
+{
+	struct dm_list *segs;
+	lvseg_list_t *segl;
+
+	if (!(segs = lvm_lv_list_lvsegs((lv_t)lv)))
+		return 0;
+
+	dm_list_iterate_items(segl, segs)
+		if (liblvm_filter_cmp(n, segl->lvseg, liblvm_filter_lvseg_property))
+			return 1;
+
+	return 0;
+}
+
+static struct lvm_property_value
+liblvm_filter_pv_property(void *pv, const char *name)
+{
+	return lvm_pv_get_property((pv_t)pv, name);
+}
+
+static struct lvm_property_value
+liblvm_filter_pvseg_property(void *pvseg, const char *name)
+{
+	return lvm_pvseg_get_property((pvseg_t)pvseg, name);
+}
+
+static int
+liblvm_filter_any_pvseg(fnode_t *n, void *pv)
+{
+	struct dm_list *segs;
+	pvseg_list_t *segl;
+
+	if (!(segs = lvm_pv_list_pvsegs((pv_t)pv)))
+		return 0;
+
+	dm_list_iterate_items(segl, segs)
+		if (liblvm_filter_cmp(n, segl->pvseg, liblvm_filter_pvseg_property))
+			return 1;
+
+	return 0;
+}
+
+static const fschema_t liblvm_lv_schema = {
+	liblvm_lv_fields, liblvm_lvseg_fields,
+	liblvm_filter_lv_property, liblvm_filter_any_lvseg, "lv_tags"
+};
+
+static const fschema_t liblvm_pv_schema = {
+	liblvm_pv_fields, liblvm_pvseg_fields,
+	liblvm_filter_pv_property, liblvm_filter_any_pvseg, "pv_tags"
+};
+
+/* Matching LVs (lvs) or PVs of the VG as lv/pv objects */
+static PyObject *
+liblvm_vg_select(vgobject *self, PyObject *args, int lvs)
+{
+	struct dm_list *list;
+	struct lvm_lv_list *lvl;
+	struct lvm_pv_list *pvl;
+	const char *expr;
+	PyObject *found;
+	PyObject *item;
+	pvobject *pvobj;
+	fnode_t *filter;
+
+	VG_VALID(self);
+
+	if (!PyArg_ParseTuple(args, "s", &expr) ||
+	    !(filter = liblvm_filter_compile(expr, lvs ? &liblvm_lv_schema : &liblvm_pv_schema))) {
+		VG_UNLOCK(self);
+		return NULL;
+	}
+
+	if (!(found = PyList_New(0)))
+		goto out;
+
+	LVM_LOCK();
+	if (lvs && (list = lvm_vg_list_lvs(self->vg))) {
+		dm_list_iterate_items(lvl, list) {
+			if (!liblvm_filter_eval(filter, lvl->lv, &liblvm_lv_schema))
+				continue;
+			if (!(item = liblvm_lv_new(self, lvl->lv)) ||
+			    PyList_Append(found, item) < 0) {
+				Py_XDECREF(item);
+				Py_CLEAR(found);
+				break;
+			}
+			Py_DECREF(item);
+		}
+	} else if (!lvs && (list = lvm_vg_list_pvs(self->vg))) {
+		dm_list_iterate_items(pvl, list) {
+			if (!liblvm_filter_eval(filter, pvl->pv, &liblvm_pv_schema))
+				continue;
+			if (!(pvobj = PyObject_New(pvobject, &LibLVMpvType))) {
+				Py_CLEAR(found);
+				break;
+			}
+			pvobj->parent_vgobj = self;
+			Py_INCREF(pvobj->parent_vgobj);
+			pvobj->pv = pvl->pv;
+			if (PyList_Append(found, (PyObject *)pvobj) < 0) {
+				Py_DECREF(pvobj);
+				Py_CLEAR(found);
+				break;
+			}
+			Py_DECREF(pvobj);
+		}
+	}
+	LVM_UNLOCK();
+
+out:
+	VG_UNLOCK(self);
+	liblvm_filter_free(filter);
+
+	if (!found)
+		return NULL;
+
+	item = PyList_AsTuple(found);
+	Py_DECREF(found);
+	return item;
+}
+
+static PyObject *
+liblvm_lvm_vg_select_lvs(vgobject *self, PyObject *args)
+{
+	return liblvm_vg_select(self, args, 1);
+}
+
+static PyObject *
+liblvm_lvm_vg_select_pvs(vgobject *self, PyObject *args)
+{
+	return liblvm_vg_select(self, args, 0);
+}
+
+/*
+ * (vgname, name) of the matching LVs (lvs) or PVs in every VG; each VG is
+ * opened read-only just for the evaluation.
+ */
+static PyObject *
+liblvm_lvm_select(PyObject *args, int lvs)
+{
+	struct dm_list *vgnames;
+	struct dm_list *list;
+	struct lvm_str_list *strl;
+	struct lvm_lv_list *lvl;
+	struct lvm_pv_list *pvl;
+	const char *expr;
+	const char *name;
+	PyObject *found;
+	PyObject *item;
+	fnode_t *filter;
+	int gone;
+	vg_t vg;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTuple(args, "s", &expr) ||
+	    !(filter = liblvm_filter_compile(expr, lvs ? &liblvm_lv_schema : &liblvm_pv_schema)))
+		return NULL;
+
+	if (!(found = PyList_New(0))) {
+		liblvm_filter_free(filter);
+		return NULL;
+	}
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
+	if (!vgnames) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		goto bail;
+	}
+
+	dm_list_iterate_items(strl, vgnames) {
+		Py_BEGIN_ALLOW_THREADS
+		vg = liblvm_vg_open_listed(strl->str, &gone);
+		Py_END_ALLOW_THREADS
+
+		if (!vg && gone)
+			continue;
+		if (!vg) {
+			PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+			goto bail;
+		}
+
+		if (lvs && (list = lvm_vg_list_lvs(vg))) {
+			dm_list_iterate_items(lvl, list) {
+				if (!liblvm_filter_eval(filter, lvl->lv, &liblvm_lv_schema))
+					continue;
+				name = lvm_lv_get_name(lvl->lv);
+				if (!(item = Py_BuildValue("(ss)", strl->str, name)) ||
+				    PyList_Append(found, item) < 0)
+					goto item_bail;
+				Py_DECREF(item);
+			}
+		} else if (!lvs && (list = lvm_vg_list_pvs(vg))) {
+			dm_list_iterate_items(pvl, list) {
+				if (!liblvm_filter_eval(filter, pvl->pv, &liblvm_pv_schema))
+					continue;
+				name = lvm_pv_get_name(pvl->pv);
+				if (!(item = Py_BuildValue("(ss)", strl->str, name)) ||
+				    PyList_Append(found, item) < 0)
+					goto item_bail;
+				Py_DECREF(item);
+			}
+		}
+		lvm_vg_close(vg);
+	}
+	LVM_UNLOCK();
+	liblvm_filter_free(filter);
+
+	item = PyList_AsTuple(found);
+	Py_DECREF(found);
+	return item;
+
+item_bail:
+	Py_XDECREF(item);
+	lvm_vg_close(vg);
+bail:
+	LVM_UNLOCK();
+	liblvm_filter_free(filter);
+	Py_DECREF(found);
+	return NULL;
+}
+
+static PyObject *
+liblvm_lvm_select_lvs(PyObject *self, PyObject *args)
+{
+	return liblvm_lvm_select(args, 1);
+}
+
+static PyObject *
+liblvm_lvm_select_pvs(PyObject *self, PyObject *args)
+{
+	return liblvm_lvm_select(args, 0);
+}
+
+/* ----------------------------------------------------------------------
+ * Capacity summary
+ */
+
+typedef struct {
+	char name[128];
+	uint64_t size;
+	uint64_t free;
+	uint64_t extent_size;
+	uint64_t extent_count;
+	uint64_t free_count;
+	uint64_t pv_count;
+	uint64_t lv_count;
+	uint64_t largest_free;		/* in extents */
+} vgcap_t;
+
+typedef struct {
+	int64_t pv;
+	uint64_t start;
+	uint64_t end;			/* inclusive */
+} perange_t;
+
+static int
+liblvm_perange_cmp(const void *a, const void *b)
+{
+	const perange_t *x = a, *y = b;
+
+	if (x->pv != y->pv)
+		return x->pv < y->pv ? -1 : 1;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Add the "pv:start-end ..." entries of a seg_pe_ranges string to ranges.
+ * Entries naming something other than a PV of the VG (sub LVs of thin
+ * pools, mirrors, ...) are skipped; their own segments cover the PVs.
+ */
+static int
+liblvm_perange_parse(const char *spec, struct dm_list *pvs,
+		     perange_t **ranges, size_t *count, size_t *alloc)
+{
+	struct lvm_pv_list *pvl;
+	const char *p = spec;
+	const char *colon;
+	const char *name;
+	const char *end;
+	const char *c;
+	perange_t *grown;
+	char *dash;
+	int64_t i;
+
+	while (p && *p) {
+		while (*p == ' ')
+			p++;
+		if (!*p)
+			break;
+		if (!(end = strchr(p, ' ')))
+			end = p + strlen(p);
+
+		/* device names may themselves contain ':' */
+		colon = NULL;
+		for (c = p; c < end; c++)
+			if (*c == ':')
+				colon = c;
+		if (!colon)
+			goto next;
+
+		i = 0;
+		dm_list_iterate_items(pvl, pvs) {
+			name = lvm_pv_get_name(pvl->pv);
+			if (strlen(name) == (size_t)(colon - p) &&
+			    !strncmp(name, p, colon - p))
+				break;
+			i++;
+		}
+		if (&pvl->list == pvs)
+			goto next;
+
+		if (*count == *alloc) {
+			*alloc = *alloc ? *alloc * 2 : 32;
+			if (!(grown = realloc(*ranges, *alloc * sizeof(perange_t))))
+				return -1;
+			*ranges = grown;
+		}
+		(*ranges)[*count].pv = i;
+		(*ranges)[*count].start = strtoull(colon + 1, &dash, 10);
+		(*ranges)[*count].end = *dash == '-' ?
+			strtoull(dash + 1, NULL, 10) : (*ranges)[*count].start;
+		(*count)++;
+next:
+		p = end;
+	}
+
+	return 0;
+}
+
+/*
+ * Longest run of unallocated extents on any allocatable PV of the VG.  The
+ * allocated ranges come from the LV segments; whatever they don't cover
+ * on a PV is free.
+ */
+static int
+liblvm_vg_largest_free(vg_t vg, uint64_t *largest)
+{
+	struct dm_list *pvs;
+	struct dm_list *lvs;
+	struct dm_list *segs;
+	struct lvm_pv_list *pvl;
+	struct lvm_lv_list *lvl;
+	struct lvm_lvseg_list *segl;
+	struct lvm_property_value prop;
+	perange_t *ranges = NULL;
+	size_t count = 0, alloc = 0, r = 0;
+	uint64_t pe_count;
+	uint64_t next;
+	int64_t i = 0;
+
+	*largest = 0;
+
+	if (!(pvs = lvm_vg_list_pvs(vg)))
+		return 0;
+
+	if ((lvs = lvm_vg_list_lvs(vg))) {
+		dm_list_iterate_items(lvl, lvs) {
+			if (!(segs = lvm_lv_list_lvsegs(lvl->lv)))
+				continue;
+			dm_list_iterate_items(segl, segs) {
+				prop = lvm_lvseg_get_property(segl->lvseg, "seg_pe_ranges");
+				if (!prop.is_valid || !prop.is_string)
+					continue;
+				if (liblvm_perange_parse(prop.value.string, pvs,
+							 &ranges, &count, &alloc) < 0) {
+					free(ranges);
+					return -1;
+				}
+			}
+		}
+	}
+
+	if (count)
+		qsort(ranges, count, sizeof(perange_t), liblvm_perange_cmp);
+
+	dm_list_iterate_items(pvl, pvs) {
+		prop = lvm_pv_get_property(pvl->pv, "pv_attr");
+		if (prop.is_valid && prop.is_string && prop.value.string[0] != 'a')
+			goto skip;
+		prop = lvm_pv_get_property(pvl->pv, "pv_pe_count");
+		if (!prop.is_valid || !prop.is_integer)
+			goto skip;
+		pe_count = prop.value.integer;
+
+		next = 0;
+		for (; r < count && ranges[r].pv == i; r++) {
+			if (ranges[r].start > next && ranges[r].start - next > *largest)
+				*largest = ranges[r].start - next;
+			if (ranges[r].end + 1 > next)
+				next = ranges[r].end + 1;
+		}
+		if (pe_count > next && pe_count - next > *largest)
+			*largest = pe_count - next;
+skip:
+		for (; r < count && ranges[r].pv == i; r++)
+			;
+		i++;
+	}
+
+	free(ranges);
+	return 0;
+}
+
+/*
+ * Read the capacity numbers of every VG into a freshly allocated array;
+ * each VG is opened read-only and closed again straight away.  The free
+ * run walk needs the segments, so callers that only rank by free space
+ * skip it.  Caller holds liblvm_lock.
+ *
+ * The VGs are read one after another, not in parallel: every open goes
+ * through libh under liblvm_lock (see the lock comment at the top).
+ * Releasing the GIL only lets other Python threads run meanwhile.
+ */
+static int
+liblvm_vg_capacities(vgcap_t **caps, size_t *count, int runs)
+{
+	struct dm_list *vgnames;
+	struct lvm_str_list *strl;
+	struct lvm_property_value prop;
+	vgcap_t *cap;
+	size_t n = 0;
+	int rc = 0;
+	int gone;
+	vg_t vg;
+
+	*caps = NULL;
+	*count = 0;
+
+	Py_BEGIN_ALLOW_THREADS
+	vgnames = lvm_list_vg_names(libh);
+	Py_END_ALLOW_THREADS
+	if (!vgnames) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		return -1;
+	}
+
+	if (!(n = dm_list_size(vgnames)))
+		return 0;
+
+	if (!(*caps = calloc(n, sizeof(vgcap_t)))) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	dm_list_iterate_items(strl, vgnames) {
+		if (!(vg = liblvm_vg_open_listed(strl->str, &gone))) {
+			if (gone)
+				continue;
+			rc = -2;
+			break;
+		}
+
+		cap = &(*caps)[*count];
+		snprintf(cap->name, sizeof(cap->name), "%s", strl->str);
+		cap->size = lvm_vg_get_size(vg);
+		cap->free = lvm_vg_get_free_size(vg);
+		cap->extent_size = lvm_vg_get_extent_size(vg);
+		cap->extent_count = lvm_vg_get_extent_count(vg);
+		cap->free_count = lvm_vg_get_free_extent_count(vg);
+		cap->pv_count = lvm_vg_get_pv_count(vg);
+		prop = lvm_vg_get_property(vg, "lv_count");
+		if (prop.is_valid && prop.is_integer)
+			cap->lv_count = prop.value.integer;
+		if (runs && liblvm_vg_largest_free(vg, &cap->largest_free) < 0)
+			rc = -1;
+
+		lvm_vg_close(vg);
+		(*count)++;
+		if (rc < 0)
+			break;
+	}
+	Py_END_ALLOW_THREADS
+
+	if (rc < 0) {
+		free(*caps);
+		*caps = NULL;
+		*count = 0;
+		if (rc == -2)
+			PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		else
+			PyErr_NoMemory();
+		rc = -1;
+	}
+
+	return rc;
+}
+
+/*
+ * {vgname: (size, free, extent_size, extent_count, free_extents, pv_count,
+ *	     lv_count, largest_free_run)}, the free run in bytes.
+ */
+static PyObject *
+liblvm_lvm_capacity_summary(void)
+{
+	PyObject *summary;
+	PyObject *item;
+	vgcap_t *caps;
+	size_t count, i;
+
+	LVM_VALID();
+
+	LVM_LOCK();
+	if (liblvm_vg_capacities(&caps, &count, 1) < 0) {
+		LVM_UNLOCK();
+		return NULL;
+	}
+	LVM_UNLOCK();
+
+	if (!(summary = PyDict_New()))
+		goto bail;
+
+	for (i = 0; i < count; i++) {
+		item = Py_BuildValue("(KKKKKKKK)",
+				     (unsigned long long)caps[i].size,
+				     (unsigned long long)caps[i].free,
+				     (unsigned long long)caps[i].extent_size,
+				     (unsigned long long)caps[i].extent_count,
+				     (unsigned long long)caps[i].free_count,
+				     (unsigned long long)caps[i].pv_count,
+				     (unsigned long long)caps[i].lv_count,
+				     (unsigned long long)(caps[i].largest_free *
+							  caps[i].extent_size));
+		if (!item || PyDict_SetItemString(summary, caps[i].name, item) < 0) {
+			Py_XDECREF(item);
+			Py_CLEAR(summary);
+			goto bail;
+		}
+		Py_DECREF(item);
+	}
+
+bail:
+	free(caps);
+	return summary;
+}
+
+static int
+liblvm_vgcap_free_cmp(const void *a, const void *b)
+{
+	const vgcap_t *x = a, *y = b;
+
+	if (x->free != y->free)
+		return x->free > y->free ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+/* ((vgname, free), ...) of the k VGs with the most free space, largest first */
+static PyObject *
+liblvm_lvm_top_vgs_by_free(PyObject *self, PyObject *args)
+{
+	PyObject *top;
+	PyObject *item;
+	vgcap_t *caps;
+	size_t count, i;
+	int k;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTuple(args, "i", &k))
+		return NULL;
+
+	if (k < 0) {
+		PyErr_SetString(PyExc_ValueError, "k must not be negative");
+		return NULL;
+	}
+
+	LVM_LOCK();
+	if (liblvm_vg_capacities(&caps, &count, 0) < 0) {
+		LVM_UNLOCK();
+		return NULL;
+	}
+	LVM_UNLOCK();
+
+	if (count)
+		qsort(caps, count, sizeof(vgcap_t), liblvm_vgcap_free_cmp);
+	if ((size_t)k < count)
+		count = k;
+
+	if (!(top = PyTuple_New(count)))
+		goto bail;
+
+	for (i = 0; i < count; i++) {
+		if (!(item = Py_BuildValue("(sK)", caps[i].name,
+					   (unsigned long long)caps[i].free))) {
+			Py_CLEAR(top);
+			goto bail;
+		}
+		PyTuple_SET_ITEM(top, i, item);
+	}
+
+bail:
+	free(caps);
+	return top;
+}
+
+/* ----------------------------------------------------------------------
+ * Decoded attribute strings
+ *
+ * lv_attr, pv_attr and vg_attr come back from lvm as strings such as
+ * "-wi-ao----"; these turn them into struct sequences with one field per
+ * position.  Enumerated positions map to names, with None for '-'.
+ */
+
+typedef struct {
+	char c;
+	const char *name;
+} attrname_t;
+
+static const attrname_t lv_volume_types[] = {
+	{ 'C', "cache" }, { 'm', "mirror" }, { 'M', "mirror-nosync" },
+	{ 'o', "origin" }, { 'O', "origin-merging" }, { 'r', "raid" },
+	{ 'R', "raid-nosync" }, { 's', "snapshot" },
+	{ 'S', "snapshot-merging" }, { 'p', "pvmove" }, { 'v', "virtual" },
+	{ 'i', "image" }, { 'I', "image-outofsync" }, { 'l', "mirror-log" },
+	{ 'c', "converting" }, { 'V', "thin" }, { 't', "thin-pool" },
+	{ 'T', "thin-pool-data" }, { 'e', "metadata" }, { 0, NULL }
+};
+
+static const attrname_t lv_permissions[] = {
+	{ 'w', "writeable" }, { 'r', "read-only" },
+	{ 'R', "read-only-activation" }, { 0, NULL }
+};
+
+static const attrname_t allocation_policies[] = {
+	{ 'a', "anywhere" }, { 'c', "contiguous" }, { 'i', "inherit" },
+	{ 'l', "cling" }, { 'n', "normal" }, { 0, NULL }
+};
+
+static const attrname_t lv_states[] = {
+	{ 'a', "active" }, { 's', "suspended" }, { 'I', "invalid-snapshot" },
+	{ 'S', "invalid-suspended-snapshot" }, { 'm', "merge-failed" },
+	{ 'M', "suspended-merge-failed" }, { 'd', "no-table" },
+	{ 'i', "inactive-table" }, { 'X', "unknown" }, { 0, NULL }
+};
+
+static const attrname_t lv_target_types[] = {
+	{ 'C', "cache" }, { 'm', "mirror" }, { 'r', "raid" },
+	{ 's', "snapshot" }, { 't', "thin" }, { 'u', "unknown" },
+	{ 'v', "virtual" }, { 0, NULL }
+};
+
+static const attrname_t lv_health[] = {
+	{ 'p', "partial" }, { 'r', "refresh-needed" }, { 'm', "mismatches" },
+	{ 'w', "writemostly" }, { 'F', "failed" }, { 'D', "out-of-data-space" },
+	{ 'M', "metadata-read-only" }, { 'X', "unknown" }, { 0, NULL }
+};
+
+static const attrname_t vg_permissions[] = {
+	{ 'w', "writeable" }, { 'r', "read-only" }, { 0, NULL }
+};
+
+static PyStructSequence_Field lvattrs_fields[] = {
+	{ "volume_type", "volume type, None for a plain LV" },
+	{ "permissions", "writeable, read-only or read-only-activation" },
+	{ "allocation", "allocation policy" },
+	{ "allocation_locked", "allocation policy is locked" },
+	{ "fixed_minor", "fixed minor number" },
+	{ "state", "activation state, None when inactive" },
+	{ "open", "device is open, None when unknown" },
+	{ "target_type", "device-mapper target type" },
+	{ "zero", "newly allocated data blocks are zeroed" },
+	{ "health", "volume health, None when fine" },
+	{ "skip_activation", "activation is skipped" },
+	{ NULL }
+};
+
+static PyStructSequence_Desc lvattrs_desc = {
+	"lvm.LvAttrs", "Decoded lv_attr", lvattrs_fields, 11
+};
+
+static PyStructSequence_Field pvattrs_fields[] = {
+	{ "allocatable", "extents can be allocated" },
+	{ "duplicate", "PV is a duplicate" },
+	{ "used", "PV is used but not in a VG seen here" },
+	{ "exported", "VG of the PV is exported" },
+	{ "missing", "PV is missing" },
+	{ NULL }
+};
+
+static PyStructSequence_Desc pvattrs_desc = {
+	"lvm.PvAttrs", "Decoded pv_attr", pvattrs_fields, 5
+};
+
+static PyStructSequence_Field vgattrs_fields[] = {
+	{ "permissions", "writeable or read-only" },
+	{ "resizeable", "VG is resizeable" },
+	{ "exported", "VG is exported" },
+	{ "partial", "one or more PVs are missing" },
+	{ "allocation", "allocation policy" },
+	{ "clustered", "VG is clustered" },
+	{ "shared", "VG is shared" },
+	{ NULL }
+};
+
+static PyStructSequence_Desc vgattrs_desc = {
+	"lvm.VgAttrs", "Decoded vg_attr", vgattrs_fields, 7
+};
+
+/* Character at pos, '-' past the end of older, shorter strings */
+static char
+liblvm_attr_char(const char *attr, size_t pos)
+{
+	return strlen(attr) > pos ? attr[pos] : '-';
+}
+
+static PyObject *
+liblvm_attr_name(const attrname_t *names, char c)
+{
+	/* allocation policies are capitalised when locked */
+	if (names == allocation_policies)
+		c = tolower((unsigned char)c);
+
+	for (; names->c; names++)
+		if (names->c == c)
+			return PyString_FromString(names->name);
+
+	if (c != '-')
+		return PyString_FromStringAndSize(&c, 1);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject *
+liblvm_attr_bool(int value)
+{
+	PyObject *rc = value ? Py_True : Py_False;
+
+	Py_INCREF(rc);
+	return rc;
+}
+
+static PyObject *
+liblvm_attr_fill(PyTypeObject *type, PyObject **values, int count)
+{
+	PyObject *attrs;
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (!values[i])
+			goto bail;
+
+	if (!(attrs = PyStructSequence_New(type)))
+		goto bail;
+
+	for (i = 0; i < count; i++)
+		PyStructSequence_SET_ITEM(attrs, i, values[i]);
+
+	return attrs;
+
+bail:
+	for (i = 0; i < count; i++)
+		Py_XDECREF(values[i]);
+	return NULL;
+}
+
+static PyObject *
+liblvm_decode_lv_attr(const char *attr)
+{
+	PyObject *v[11];
+	char c;
+
+	v[0] = liblvm_attr_name(lv_volume_types, liblvm_attr_char(attr, 0));
+	v[1] = liblvm_attr_name(lv_permissions, liblvm_attr_char(attr, 1));
+	v[2] = liblvm_attr_name(allocation_policies, liblvm_attr_char(attr, 2));
+	v[3] = liblvm_attr_bool(isupper((unsigned char)liblvm_attr_char(attr, 2)));
+	v[4] = liblvm_attr_bool(liblvm_attr_char(attr, 3) == 'm');
+	v[5] = liblvm_attr_name(lv_states, liblvm_attr_char(attr, 4));
+	c = liblvm_attr_char(attr, 5);
+	if (c == 'X') {
+		Py_INCREF(Py_None);
+		v[6] = Py_None;
+	} else
+		v[6] = liblvm_attr_bool(c == 'o');
+	v[7] = liblvm_attr_name(lv_target_types, liblvm_attr_char(attr, 6));
+	v[8] = liblvm_attr_bool(liblvm_attr_char(attr, 7) == 'z');
+	v[9] = liblvm_attr_name(lv_health, liblvm_attr_char(attr, 8));
+	v[10] = liblvm_attr_bool(liblvm_attr_char(attr, 9) == 'k');
+
+	return liblvm_attr_fill(&LibLVMlvattrsType, v, 11);
+}
+
+static PyObject *
+liblvm_decode_pv_attr(const char *attr)
+{
+	PyObject *v[5];
+	char c = liblvm_attr_char(attr, 0);
+
+	v[0] = liblvm_attr_bool(c == 'a');
+	v[1] = liblvm_attr_bool(c == 'd');
+	v[2] = liblvm_attr_bool(c == 'u');
+	v[3] = liblvm_attr_bool(liblvm_attr_char(attr, 1) == 'x');
+	v[4] = liblvm_attr_bool(liblvm_attr_char(attr, 2) == 'm');
+
+	return liblvm_attr_fill(&LibLVMpvattrsType, v, 5);
+}
+
+static PyObject *
+liblvm_decode_vg_attr(const char *attr)
+{
+	PyObject *v[7];
+
+	v[0] = liblvm_attr_name(vg_permissions, liblvm_attr_char(attr, 0));
+	v[1] = liblvm_attr_bool(liblvm_attr_char(attr, 1) == 'z');
+	v[2] = liblvm_attr_bool(liblvm_attr_char(attr, 2) == 'x');
+	v[3] = liblvm_attr_bool(liblvm_attr_char(attr, 3) == 'p');
+	v[4] = liblvm_attr_name(allocation_policies, liblvm_attr_char(attr, 4));
+	v[5] = liblvm_attr_bool(liblvm_attr_char(attr, 5) == 'c');
+	v[6] = liblvm_attr_bool(liblvm_attr_char(attr, 5) == 's');
+
+	return liblvm_attr_fill(&LibLVMvgattrsType, v, 7);
+}
+
+static PyObject *
+liblvm_attr_property(struct lvm_property_value *prop,
+		     PyObject *(*decode)(const char *), vgobject *vgobj)
+{
+	if (!prop->is_valid || !prop->is_string || !prop->value.string) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return NULL;
+	}
+
+	return decode(prop->value.string);
+}
+
+static PyObject *
+liblvm_lvm_vg_attrs(vgobject *self)
+{
+	struct lvm_property_value prop;
+	PyObject *rc;
+
+	VG_VALID(self);
+
+	LVM_LOCK();
+	prop = lvm_vg_get_property(self->vg, "vg_attr");
+	rc = liblvm_attr_property(&prop, liblvm_decode_vg_attr, self);
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_lv_attrs(lvobject *self)
+{
+	struct lvm_property_value prop;
+	PyObject *rc;
+
+	LV_VALID(self);
+
+	/* the state positions are read from device-mapper through libh */
+	LVM_LOCK();
+	prop = lvm_lv_get_property(self->lv, "lv_attr");
+	rc = liblvm_attr_property(&prop, liblvm_decode_lv_attr, self->parent_vgobj);
+	LVM_UNLOCK();
+	LV_UNLOCK(self);
+
+	return rc;
+}
+
+static PyObject *
+liblvm_lvm_pv_attrs(pvobject *self)
+{
+	struct lvm_property_value prop;
+	PyObject *rc;
+
+	PV_VALID(self);
+
+	LVM_LOCK();
+	prop = lvm_pv_get_property(self->pv, "pv_attr");
+	rc = liblvm_attr_property(&prop, liblvm_decode_pv_attr, self->parent_vgobj);
+	LVM_UNLOCK();
+	PV_UNLOCK(self);
+
+	return rc;
+}
+
+/*
+ * Module level decoders for attribute strings that come out of the bulk
+ * calls (inventory, serializeAll, inventoryReader, brokerConnect, ...)
+ */
+static PyObject *
+liblvm_lvm_decode_lv_attr(PyObject *self, PyObject *args)
+{
+	const char *attr;
+
+	if (!PyArg_ParseTuple(args, "s", &attr))
+		return NULL;
+
+	return liblvm_decode_lv_attr(attr);
+}
+
+static PyObject *
+liblvm_lvm_decode_pv_attr(PyObject *self, PyObject *args)
+{
+	const char *attr;
+
+	if (!PyArg_ParseTuple(args, "s", &attr))
+		return NULL;
+
+	return liblvm_decode_pv_attr(attr);
+}
+
+static PyObject *
+liblvm_lvm_decode_vg_attr(PyObject *self, PyObject *args)
+{
+	const char *attr;
+
+	if (!PyArg_ParseTuple(args, "s", &attr))
+		return NULL;
+
+	return liblvm_decode_vg_attr(attr);
+}
+
+/* ----------------------------------------------------------------------
+ * PV throughput probe
+ *
+ * Short read-only O_DIRECT benchmarks of the data area of a PV, i.e.
+ * from pe_start on, so label and metadata areas are never read.  Each
+ * probe runs qd threads issuing blocking preads, which keeps qd requests
+ * in flight on the device.
+ */
+
+#define PROBE_ALIGN	4096
+#define PROBE_MAX_QD	64
+#define PROBE_MAX_IOS	(1 << 20)
+
+typedef struct {
+	int random;
+	uint64_t size;		/* bytes to read per PV */
+	uint64_t bs;
+	int qd;
+} probeopts_t;
+
+typedef struct {
+	char path[256];
+	uint64_t start;		/* byte offset of the data area */
+	uint64_t len;		/* usable bytes, a multiple of bs */
+	uint64_t bs;
+	int random;
+	uint64_t count;		/* I/Os to issue */
+	uint64_t next;		/* next I/O to issue, shared by the workers */
+	double *lat;		/* per I/O latency in ms */
+	double start_ms;
+	double end_ms;		/* set by the last worker to finish */
+	int running;		/* workers not yet finished */
+	int fd;
+	int err;
+} probe_t;
+
+typedef struct {
+	probe_t *probe;
+	unsigned int seed;
+	pthread_t thread;
+} probeworker_t;
+
+static char *liblvm_probe_kwlist[] = { "pattern", "size", "qd", "bs", NULL };
+
+static int
+liblvm_probe_opts(PyObject *args, PyObject *kwds, probeopts_t *opts)
+{
+	const char *pattern = "seqread";
+	unsigned long long size = 64ULL << 20;
+	unsigned long long bs = 0;
+	int qd = 1;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sKiK", liblvm_probe_kwlist,
+					 &pattern, &size, &qd, &bs))
+		return -1;
+
+	if (!strcmp(pattern, "seqread"))
+		opts->random = 0;
+	else if (!strcmp(pattern, "randread"))
+		opts->random = 1;
+	else {
+		PyErr_SetString(PyExc_ValueError,
+				"pattern must be 'seqread' or 'randread'");
+		return -1;
+	}
+
+	if (!bs)
+		bs = opts->random ? 4096 : 1 << 20;
+
+	if (bs % PROBE_ALIGN) {
+		PyErr_Format(PyExc_ValueError, "bs must be a multiple of %d",
+			     PROBE_ALIGN);
+		return -1;
+	}
+
+	if (qd < 1 || qd > PROBE_MAX_QD) {
+		PyErr_Format(PyExc_ValueError, "qd must be between 1 and %d",
+			     PROBE_MAX_QD);
+		return -1;
+	}
+
+	if (size < bs || size / bs > PROBE_MAX_IOS) {
+		PyErr_SetString(PyExc_ValueError,
+				"size must cover between one and 2^20 blocks");
+		return -1;
+	}
+
+	opts->size = size;
+	opts->bs = bs;
+	opts->qd = qd;
+
+	return 0;
+}
+
+/* Caller holds liblvm_lock */
+static int
+liblvm_probe_setup(probe_t *probe, vgobject *vgobj, pv_t pv, probeopts_t *opts)
+{
+	struct lvm_property_value prop;
 
-	return pytuple;
-}
+	memset(probe, 0, sizeof(*probe));
+	probe->fd = -1;
 
-/* PV Methods */
+	prop = lvm_pv_get_property(pv, "pe_start");
+	if (!prop.is_valid || !prop.is_integer) {
+		PyErr_SetObject(LibLVMError, liblvm_get_vg_error(vgobj));
+		return -1;
+	}
 
-#define PV_VALID(pvobject)						\
-	do {								\
-		VG_VALID(pvobject->parent_vgobj);			\
-		if (!pvobject->pv) {					\
-			PyErr_SetString(PyExc_UnboundLocalError, "PV object invalid"); \
-			return NULL;					\
-		}							\
-	} while (0)
+	snprintf(probe->path, sizeof(probe->path), "%s", lvm_pv_get_name(pv));
+	probe->start = prop.value.integer;
+	probe->bs = opts->bs;
+	probe->len = lvm_pv_get_size(pv) / opts->bs * opts->bs;
+	probe->random = opts->random;
+	probe->count = opts->size / opts->bs;
+
+	if (!probe->len || probe->start % PROBE_ALIGN) {
+		PyErr_Format(PyExc_ValueError,
+			     "%s: data area too small or misaligned", probe->path);
+		return -1;
+	}
 
-static PyObject *
-liblvm_lvm_pv_get_name(pvobject *self)
-{
-	PV_VALID(self);
+	if (!(probe->lat = malloc(probe->count * sizeof(double)))) {
+		PyErr_NoMemory();
+		return -1;
+	}
 
-	return Py_BuildValue("s", lvm_pv_get_name(self->pv));
+	return 0;
 }
 
-static PyObject *
-liblvm_lvm_pv_get_uuid(pvobject *self)
+static void
+liblvm_probe_free(probe_t *probe)
 {
-	PV_VALID(self);
+	if (probe->fd >= 0)
+		close(probe->fd);
+	free(probe->lat);
+	probe->fd = -1;
+	probe->lat = NULL;
+}
 
-	return Py_BuildValue("s", lvm_pv_get_uuid(self->pv));
+/* Stamps end_ms once the last of a probe's workers is done */
+static void
+liblvm_probe_done(probe_t *probe, int workers)
+{
+	if (!__sync_sub_and_fetch(&probe->running, workers))
+		probe->end_ms = liblvm_now_ms();
 }
 
-static PyObject *
-liblvm_lvm_pv_get_mda_count(pvobject *self)
+static void *
+liblvm_probe_worker(void *arg)
 {
-	PV_VALID(self);
+	probeworker_t *w = arg;
+	probe_t *probe = w->probe;
+	uint64_t blocks = probe->len / probe->bs;
+	uint64_t i, block;
+	double t0;
+	ssize_t n;
+	void *buf;
+
+	if (posix_memalign(&buf, PROBE_ALIGN, probe->bs)) {
+		__sync_bool_compare_and_swap(&probe->err, 0, ENOMEM);
+		liblvm_probe_done(probe, 1);
+		return NULL;
+	}
+
+	while ((i = __sync_fetch_and_add(&probe->next, 1)) < probe->count &&
+	       !probe->err) {
+		if (probe->random)
+			block = (((uint64_t)rand_r(&w->seed) << 31) ^
+				 rand_r(&w->seed)) % blocks;
+		else
+			block = i % blocks;
+
+		t0 = liblvm_now_ms();
+		n = pread(probe->fd, buf, probe->bs, probe->start + block * probe->bs);
+		probe->lat[i] = liblvm_now_ms() - t0;
+
+		if (n != (ssize_t)probe->bs) {
+			__sync_bool_compare_and_swap(&probe->err, 0, n < 0 ? errno : EIO);
+			break;
+		}
+	}
 
-	return Py_BuildValue("K", (unsigned long long)lvm_pv_get_mda_count(self->pv));
+	free(buf);
+	liblvm_probe_done(probe, 1);
+	return NULL;
 }
 
-static PyObject *
-liblvm_lvm_pv_get_property(pvobject *self,  PyObject *args)
+/*
+ * Run all probes at once, qd workers each.  Called without the GIL;
+ * failures are left in probe->err.
+ */
+static void
+liblvm_probe_run(probe_t *probes, size_t count, int qd)
 {
-	const char *name;
-	struct lvm_property_value prop_value;
+	probeworker_t *workers;
+	size_t i, started = 0;
+	int j;
 
-	PV_VALID(self);
+	for (i = 0; i < count; i++)
+		if ((probes[i].fd = open(probes[i].path, O_RDONLY | O_DIRECT)) < 0)
+			probes[i].err = errno;
 
-	if (!PyArg_ParseTuple(args, "s", &name))
-		return NULL;
+	if (!(workers = calloc(count * qd, sizeof(probeworker_t)))) {
+		for (i = 0; i < count; i++)
+			probes[i].err = ENOMEM;
+		return;
+	}
 
-	prop_value = lvm_pv_get_property(self->pv, name);
-	return get_property(&prop_value);
-}
+	for (i = 0; i < count; i++) {
+		if (probes[i].err)
+			continue;
+		probes[i].running = qd;
+		probes[i].start_ms = liblvm_now_ms();
+		for (j = 0; j < qd; j++) {
+			workers[started].probe = &probes[i];
+			workers[started].seed = (unsigned int)(i * PROBE_MAX_QD + j) ^
+						(unsigned int)getpid();
+			if (pthread_create(&workers[started].thread, NULL,
+					   liblvm_probe_worker, &workers[started])) {
+				probes[i].err = EAGAIN;
+				liblvm_probe_done(&probes[i], qd - j);
+				break;
+			}
+			started++;
+		}
+	}
 
-static PyObject *
-liblvm_lvm_pv_get_dev_size(pvobject *self)
-{
-	PV_VALID(self);
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
 
-	return Py_BuildValue("K", (unsigned long long)lvm_pv_get_dev_size(self->pv));
+	free(workers);
 }
 
-static PyObject *
-liblvm_lvm_pv_get_size(pvobject *self)
+static int
+liblvm_double_cmp(const void *a, const void *b)
 {
-	PV_VALID(self);
+	double x = *(const double *)a, y = *(const double *)b;
 
-	return Py_BuildValue("K", (unsigned long long)lvm_pv_get_size(self->pv));
+	return x < y ? -1 : x > y;
 }
 
+/* (bytes/s, IOPS, p50, p95, p99, max), latencies in microseconds */
 static PyObject *
-liblvm_lvm_pv_get_free(pvobject *self)
+liblvm_probe_result(probe_t *probe)
 {
-	PV_VALID(self);
+	double secs = (probe->end_ms - probe->start_ms) / 1000.0;
+	uint64_t n = probe->count;
+
+	if (probe->err) {
+		errno = probe->err;
+		return PyErr_SetFromErrnoWithFilename(PyExc_OSError, probe->path);
+	}
+
+	if (secs <= 0)
+		secs = 1e-9;
 
-	return Py_BuildValue("K", (unsigned long long)lvm_pv_get_free(self->pv));
+	qsort(probe->lat, n, sizeof(double), liblvm_double_cmp);
+
+	return Py_BuildValue("(dddddd)", n * probe->bs / secs, n / secs,
+			     probe->lat[(n - 1) * 50 / 100] * 1000.0,
+			     probe->lat[(n - 1) * 95 / 100] * 1000.0,
+			     probe->lat[(n - 1) * 99 / 100] * 1000.0,
+			     probe->lat[n - 1] * 1000.0);
 }
 
 static PyObject *
-liblvm_lvm_pv_resize(pvobject *self, PyObject *args)
+liblvm_lvm_pv_probe(pvobject *self, PyObject *args, PyObject *kwds)
 {
-	uint64_t new_size;
-	int rval;
+	probeopts_t opts;
+	probe_t probe;
+	PyObject *rc;
+	int ret;
 
 	PV_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "l", &new_size)) {
+	if (liblvm_probe_opts(args, kwds, &opts) < 0) {
+		PV_UNLOCK(self);
 		return NULL;
 	}
 
-	if ((rval = lvm_pv_resize(self->pv, new_size)) == -1) {
-		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+	LVM_LOCK();
+	ret = liblvm_probe_setup(&probe, self->parent_vgobj, self->pv, &opts);
+	LVM_UNLOCK();
+	PV_UNLOCK(self);
+
+	if (ret < 0) {
+		liblvm_probe_free(&probe);
 		return NULL;
 	}
 
-	Py_INCREF(Py_None);
-	return Py_None;
+	Py_BEGIN_ALLOW_THREADS
+	liblvm_probe_run(&probe, 1, opts.qd);
+	Py_END_ALLOW_THREADS
+
+	rc = liblvm_probe_result(&probe);
+	liblvm_probe_free(&probe);
+
+	return rc;
 }
 
+/*
+ * {pv_name: (bytes/s, IOPS, p50, p95, p99, max)} with all PVs probed at
+ * the same time; PVs that can't be opened (missing) map to None.
+ */
 static PyObject *
-liblvm_lvm_pv_list_pvsegs(pvobject *self)
+liblvm_lvm_vg_probe_pvs(vgobject *self, PyObject *args, PyObject *kwds)
 {
-	struct dm_list *pvsegs;
-	pvseg_list_t *pvsegl;
-	PyObject *pytuple;
-	pvsegobject *pvsegobj;
-	int i = 0;
-
-	PV_VALID(self);
+	struct dm_list *pvs;
+	struct lvm_pv_list *pvl;
+	probeopts_t opts;
+	probe_t *probes = NULL;
+	size_t count = 0, i;
+	PyObject *results = NULL;
+	PyObject *item;
 
-	pvsegs = lvm_pv_list_pvsegs(self->pv);
-	if (!pvsegs) {
-		return Py_BuildValue("()");
-	}
+	VG_VALID(self);
 
-	pytuple = PyTuple_New(dm_list_size(pvsegs));
-	if (!pytuple)
+	if (liblvm_probe_opts(args, kwds, &opts) < 0) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
-	dm_list_iterate_items(pvsegl, pvsegs) {
-		/* Create and initialize the object */
-		pvsegobj = PyObject_New(pvsegobject, &LibLVMpvsegType);
-		if (!pvsegobj) {
-			Py_DECREF(pytuple);
-			return NULL;
+	LVM_LOCK();
+	if ((pvs = lvm_vg_list_pvs(self->vg)) && dm_list_size(pvs)) {
+		if (!(probes = calloc(dm_list_size(pvs), sizeof(probe_t)))) {
+			PyErr_NoMemory();
+			goto unlock;
 		}
-
-		pvsegobj->parent_pvobj = self;
-		Py_INCREF(pvsegobj->parent_pvobj);
-
-		pvsegobj->pv_seg = pvsegl->pvseg;
-		PyTuple_SET_ITEM(pytuple, i, (PyObject *) pvsegobj);
-		i++;
+		dm_list_iterate_items(pvl, pvs)
+			if (liblvm_probe_setup(&probes[count++], self, pvl->pv, &opts) < 0)
+				goto unlock;
+	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	Py_BEGIN_ALLOW_THREADS
+	liblvm_probe_run(probes, count, opts.qd);
+	Py_END_ALLOW_THREADS
+
+	if (!(results = PyDict_New()))
+		goto bail;
+
+	for (i = 0; i < count; i++) {
+		if (probes[i].err == ENOENT || probes[i].err == ENXIO) {
+			Py_INCREF(Py_None);
+			item = Py_None;
+		} else if (!(item = liblvm_probe_result(&probes[i]))) {
+			Py_CLEAR(results);
+			goto bail;
+		}
+		if (PyDict_SetItemString(results, probes[i].path, item) < 0) {
+			Py_DECREF(item);
+			Py_CLEAR(results);
+			goto bail;
+		}
+		Py_DECREF(item);
 	}
+	goto bail;
 
-	return pytuple;
+unlock:
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+bail:
+	for (i = 0; i < count; i++)
+		liblvm_probe_free(&probes[i]);
+	free(probes);
+	return results;
 }
 
-/* LV seg methods */
-
-/*
- * No way to close/destroy an lvseg, just need to make sure parents are
- * still good
+/* ----------------------------------------------------------------------
+ * Extent moves
+ *
+ * This is a read-only progress tracker, not extent migration: there is
+ * no vg.moveExtents() and handles have no abort().  lvm2app has no call
+ * to start or abort a pvmove, so moves are started and aborted with
+ * pvmove(8) as before.  What we can do is follow them: a move in progress
+ * shows up as a hidden pvmove LV ('p' volume type) whose copy_percent is
+ * the progress.  A handle only keeps the names and rereads the VG on
+ * every poll, since an open VG handle never sees the metadata move on.
  */
-#define LVSEG_VALID(lvsegobject) LV_VALID(lvsegobject->parent_lvobj)
+
+typedef struct {
+	PyObject_HEAD
+	char vgname[128];
+	char name[128];
+} moveobject;
 
 static void
-liblvm_lvseg_dealloc(lvsegobject *self)
+liblvm_move_dealloc(moveobject *self)
 {
-	Py_DECREF(self->parent_lvobj);
 	PyObject_Del(self);
 }
 
+/* Moves in progress in the VG, as handles */
 static PyObject *
-liblvm_lvm_lvseg_get_property(lvsegobject *self,  PyObject *args)
+liblvm_lvm_vg_list_moves(vgobject *self)
 {
-	const char *name;
-	struct lvm_property_value prop_value;
+	struct dm_list *lvs;
+	struct lvm_lv_list *lvl;
+	struct lvm_property_value prop;
+	moveobject *move;
+	PyObject *moves;
+	PyObject *rc;
 
-	LVSEG_VALID(self);
+	VG_VALID(self);
 
-	if (!PyArg_ParseTuple(args, "s", &name))
+	if (!(moves = PyList_New(0))) {
+		VG_UNLOCK(self);
 		return NULL;
+	}
 
-	prop_value = lvm_lvseg_get_property(self->lv_seg, name);
-	return get_property(&prop_value);
-}
+	LVM_LOCK();
+	if ((lvs = lvm_vg_list_lvs(self->vg))) {
+		dm_list_iterate_items(lvl, lvs) {
+			prop = lvm_lv_get_property(lvl->lv, "lv_attr");
+			if (!prop.is_valid || !prop.is_string || prop.value.string[0] != 'p')
+				continue;
 
-/* PV seg methods */
+			if (!(move = PyObject_New(moveobject, &LibLVMmoveType)))
+				goto bail;
+			snprintf(move->vgname, sizeof(move->vgname), "%s",
+				 lvm_vg_get_name(self->vg));
+			snprintf(move->name, sizeof(move->name), "%s",
+				 lvm_lv_get_name(lvl->lv));
+			if (PyList_Append(moves, (PyObject *)move) < 0) {
+				Py_DECREF(move);
+				goto bail;
+			}
+			Py_DECREF(move);
+		}
+	}
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+
+	rc = PyList_AsTuple(moves);
+	Py_DECREF(moves);
+	return rc;
+
+bail:
+	LVM_UNLOCK();
+	VG_UNLOCK(self);
+	Py_DECREF(moves);
+	return NULL;
+}
 
 /*
- * No way to close/destroy a pvseg, just need to make sure parents are
- * still good
+ * Fresh copy_percent of the move: 1 with *percent set while it runs
+ * (negative if lvm has no valid percentage for it), 0 once its pvmove LV
+ * is gone, -1 with an exception set on error.
  */
-#define PVSEG_VALID(pvsegobject) PV_VALID(pvsegobject->parent_pvobj)
+static int
+liblvm_move_percent(moveobject *self, double *percent)
+{
+	struct lvm_property_value prop;
+	lv_t lv;
+	vg_t vg;
+	int rc = 0;
+
+	LVM_LOCK();
+	Py_BEGIN_ALLOW_THREADS
+	vg = lvm_vg_open(libh, self->vgname, "r", 0);
+	Py_END_ALLOW_THREADS
+	if (!vg) {
+		PyErr_SetObject(LibLVMError, liblvm_get_last_error());
+		LVM_UNLOCK();
+		return -1;
+	}
 
-static void
-liblvm_pvseg_dealloc(pvsegobject *self)
+	if ((lv = lvm_lv_from_name(vg, self->name))) {
+		prop = lvm_lv_get_property(lv, "copy_percent");
+		*percent = -1.0;
+		if (prop.is_valid && prop.is_integer &&
+		    (percent_t)prop.value.integer != (percent_t)-1)
+			*percent = lvm_percent_to_float((percent_t)prop.value.integer);
+		rc = 1;
+	}
+	lvm_vg_close(vg);
+	LVM_UNLOCK();
+
+	return rc;
+}
+
+static PyObject *
+liblvm_move_get_name(moveobject *self)
 {
-	Py_DECREF(self->parent_pvobj);
-	PyObject_Del(self);
+	return Py_BuildValue("s", self->name);
 }
 
+/*
+ * Percent copied, or None once the move has finished or been aborted, or
+ * while lvm can't tell how far it got
+ */
 static PyObject *
-liblvm_lvm_pvseg_get_property(pvsegobject *self,  PyObject *args)
+liblvm_move_progress(moveobject *self)
 {
-	const char *name;
-	struct lvm_property_value prop_value;
+	double percent;
+	int rc;
 
-	PVSEG_VALID(self);
+	LVM_VALID();
 
-	if (!PyArg_ParseTuple(args, "s", &name))
+	if ((rc = liblvm_move_percent(self, &percent)) < 0)
 		return NULL;
 
-	prop_value = lvm_pvseg_get_property(self->pv_seg, name);
-	return get_property(&prop_value);
+	if (!rc || percent < 0) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	return Py_BuildValue("d", percent);
+}
+
+static char *liblvm_move_wait_kwlist[] = { "timeout", "interval", NULL };
+
+/* Poll until the move is gone; False if timeout (seconds) ran out first */
+static PyObject *
+liblvm_move_wait(moveobject *self, PyObject *args, PyObject *kwds)
+{
+	PyObject *timeout_arg = Py_None;
+	double interval = 1.0;
+	double deadline = 0;
+	double timeout;
+	double percent;
+	int rc;
+
+	LVM_VALID();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Od", liblvm_move_wait_kwlist,
+					 &timeout_arg, &interval))
+		return NULL;
+
+	if (interval <= 0) {
+		PyErr_SetString(PyExc_ValueError, "interval must be positive");
+		return NULL;
+	}
+
+	if (timeout_arg != Py_None) {
+		timeout = PyFloat_AsDouble(timeout_arg);
+		if (timeout == -1.0 && PyErr_Occurred())
+			return NULL;
+		deadline = liblvm_now_ms() + timeout * 1000;
+	}
+
+	while ((rc = liblvm_move_percent(self, &percent)) > 0) {
+		if (timeout_arg != Py_None && liblvm_now_ms() >= deadline) {
+			Py_INCREF(Py_False);
+			return Py_False;
+		}
+
+		Py_BEGIN_ALLOW_THREADS
+		usleep((useconds_t)(interval * 1000000));
+		Py_END_ALLOW_THREADS
+
+		if (PyErr_CheckSignals() < 0)
+			return NULL;
+	}
+
+	if (rc < 0)
+		return NULL;
+
+	Py_INCREF(Py_True);
+	return Py_True;
 }
 
 /* ----------------------------------------------------------------------
@@ -1517,19 +9729,43 @@ liblvm_lvm_pvseg_get_property(pvsegobject *self,  PyObject *args)
 static PyMethodDef Liblvm_methods[] = {
 	/* LVM methods */
 	{ "getVersion",		(PyCFunction)liblvm_library_get_version, METH_NOARGS },
-	{ "vgOpen",		(PyCFunction)liblvm_lvm_vg_open, METH_VARARGS },
+	{ "vgOpen",		(PyCFunction)liblvm_lvm_vg_open, METH_VARARGS | METH_KEYWORDS },
 	{ "vgCreate",		(PyCFunction)liblvm_lvm_vg_create, METH_VARARGS },
+	{ "pvCreate",		(PyCFunction)liblvm_lvm_pv_create, METH_VARARGS | METH_KEYWORDS },
+	{ "init",		(PyCFunction)liblvm_lvm_init, METH_VARARGS | METH_KEYWORDS },
+	{ "reinit",		(PyCFunction)liblvm_lvm_reinit, METH_VARARGS | METH_KEYWORDS },
 	{ "configFindBool",	(PyCFunction)liblvm_lvm_config_find_bool, METH_VARARGS },
 	{ "configReload",	(PyCFunction)liblvm_lvm_config_reload, METH_NOARGS },
 	{ "configOverride",	(PyCFunction)liblvm_lvm_config_override, METH_VARARGS },
 	{ "scan",		(PyCFunction)liblvm_lvm_scan, METH_NOARGS },
 	{ "listVgNames",	(PyCFunction)liblvm_lvm_list_vg_names, METH_NOARGS },
 	{ "listVgUuids",	(PyCFunction)liblvm_lvm_list_vg_uuids, METH_NOARGS },
-#if 0
 	{ "percentToFloat",	(PyCFunction)liblvm_lvm_percent_to_float, METH_VARARGS },
-#endif
+	{ "decodeLvAttr",	(PyCFunction)liblvm_lvm_decode_lv_attr, METH_VARARGS },
+	{ "decodePvAttr",	(PyCFunction)liblvm_lvm_decode_pv_attr, METH_VARARGS },
+	{ "decodeVgAttr",	(PyCFunction)liblvm_lvm_decode_vg_attr, METH_VARARGS },
 	{ "vgNameFromPvid",	(PyCFunction)liblvm_lvm_vgname_from_pvid, METH_VARARGS },
 	{ "vgNameFromDevice",	(PyCFunction)liblvm_lvm_vgname_from_device, METH_VARARGS },
+	{ "serializeAll",	(PyCFunction)liblvm_lvm_serialize_all, METH_VARARGS | METH_KEYWORDS },
+	{ "inventory",		(PyCFunction)liblvm_lvm_inventory, METH_NOARGS },
+	{ "diff",		(PyCFunction)liblvm_lvm_diff, METH_VARARGS },
+	{ "watch",		(PyCFunction)liblvm_lvm_watch, METH_VARARGS | METH_KEYWORDS },
+	{ "waitForSeqnoChange",	(PyCFunction)liblvm_lvm_wait_for_seqno_change, METH_VARARGS | METH_KEYWORDS },
+	{ "utilization",	(PyCFunction)liblvm_lvm_utilization, METH_NOARGS },
+	{ "activationStates",	(PyCFunction)liblvm_lvm_activation_states, METH_NOARGS },
+	{ "capacitySummary",	(PyCFunction)liblvm_lvm_capacity_summary, METH_NOARGS },
+	{ "topVgsByFree",	(PyCFunction)liblvm_lvm_top_vgs_by_free, METH_VARARGS },
+	{ "publishInventory",	(PyCFunction)liblvm_lvm_publish_inventory, METH_VARARGS | METH_KEYWORDS },
+	{ "inventoryReader",	(PyCFunction)liblvm_lvm_inventory_reader, METH_VARARGS },
+	{ "brokerServe",	(PyCFunction)liblvm_lvm_broker_serve, METH_VARARGS | METH_KEYWORDS },
+	{ "brokerConnect",	(PyCFunction)liblvm_lvm_broker_connect, METH_VARARGS },
+	{ "lockStats",		(PyCFunction)liblvm_lvm_lock_stats, METH_NOARGS },
+	{ "findVgsByTag",	(PyCFunction)liblvm_lvm_find_vgs_by_tag, METH_VARARGS },
+	{ "findLvsByTag",	(PyCFunction)liblvm_lvm_find_lvs_by_tag, METH_VARARGS },
+	{ "rebuildTagIndex",	(PyCFunction)liblvm_lvm_rebuild_tag_index, METH_NOARGS },
+	{ "selectLvs",		(PyCFunction)liblvm_lvm_select_lvs, METH_VARARGS },
+	{ "selectPvs",		(PyCFunction)liblvm_lvm_select_pvs, METH_VARARGS },
+	{ "setLockWarning",	(PyCFunction)liblvm_lvm_set_lock_warning, METH_VARARGS },
 	{ NULL,	     NULL}	   /* sentinel */
 };
 
@@ -1538,6 +9774,8 @@ static PyMethodDef liblvm_vg_methods[] = {
 	{ "getName",		(PyCFunction)liblvm_lvm_vg_get_name, METH_NOARGS },
 	{ "getUuid",		(PyCFunction)liblvm_lvm_vg_get_uuid, METH_NOARGS },
 	{ "close",		(PyCFunction)liblvm_lvm_vg_close, METH_NOARGS },
+	{ "__enter__",		(PyCFunction)liblvm_lvm_vg_enter, METH_NOARGS },
+	{ "__exit__",		(PyCFunction)liblvm_lvm_vg_exit, METH_VARARGS },
 	{ "remove",		(PyCFunction)liblvm_lvm_vg_remove, METH_NOARGS },
 	{ "extend",		(PyCFunction)liblvm_lvm_vg_extend, METH_VARARGS },
 	{ "reduce",		(PyCFunction)liblvm_lvm_vg_reduce, METH_VARARGS },
@@ -1548,12 +9786,14 @@ static PyMethodDef liblvm_vg_methods[] = {
 	{ "isExported",		(PyCFunction)liblvm_lvm_vg_is_exported, METH_NOARGS },
 	{ "isPartial",		(PyCFunction)liblvm_lvm_vg_is_partial, METH_NOARGS },
 	{ "getSeqno",		(PyCFunction)liblvm_lvm_vg_get_seqno, METH_NOARGS },
+	{ "isLockless",		(PyCFunction)liblvm_lvm_vg_is_lockless, METH_NOARGS },
 	{ "getSize",		(PyCFunction)liblvm_lvm_vg_get_size, METH_NOARGS },
 	{ "getFreeSize",	(PyCFunction)liblvm_lvm_vg_get_free_size, METH_NOARGS },
 	{ "getExtentSize",	(PyCFunction)liblvm_lvm_vg_get_extent_size, METH_NOARGS },
 	{ "getExtentCount",	(PyCFunction)liblvm_lvm_vg_get_extent_count, METH_NOARGS },
 	{ "getFreeExtentCount",	(PyCFunction)liblvm_lvm_vg_get_free_extent_count, METH_NOARGS },
 	{ "getProperty",	(PyCFunction)liblvm_lvm_vg_get_property, METH_VARARGS },
+	{ "attrs",		(PyCFunction)liblvm_lvm_vg_attrs, METH_NOARGS },
 	{ "setProperty",	(PyCFunction)liblvm_lvm_vg_set_property, METH_VARARGS },
 	{ "getPvCount",		(PyCFunction)liblvm_lvm_vg_get_pv_count, METH_NOARGS },
 	{ "getMaxPv",		(PyCFunction)liblvm_lvm_vg_get_max_pv, METH_NOARGS },
@@ -1566,6 +9806,18 @@ static PyMethodDef liblvm_vg_methods[] = {
 	{ "pvFromUuid", 	(PyCFunction)liblvm_lvm_pv_from_uuid, METH_VARARGS },
 	{ "getTags",		(PyCFunction)liblvm_lvm_vg_get_tags, METH_NOARGS },
 	{ "createLvLinear",	(PyCFunction)liblvm_lvm_vg_create_lv_linear, METH_VARARGS },
+	{ "createThinPool",	(PyCFunction)liblvm_lvm_vg_create_thin_pool, METH_VARARGS | METH_KEYWORDS },
+	{ "createLvThin",	(PyCFunction)liblvm_lvm_vg_create_lv_thin, METH_VARARGS | METH_KEYWORDS },
+	{ "lvSegmentTable",	(PyCFunction)liblvm_lvm_vg_lvseg_table, METH_NOARGS },
+	{ "pvSegmentTable",	(PyCFunction)liblvm_lvm_vg_pvseg_table, METH_NOARGS },
+	{ "serialize",		(PyCFunction)liblvm_lvm_vg_serialize, METH_VARARGS | METH_KEYWORDS },
+	{ "utilization",	(PyCFunction)liblvm_lvm_vg_utilization, METH_NOARGS },
+	{ "activationStates",	(PyCFunction)liblvm_lvm_vg_activation_states, METH_NOARGS },
+	{ "selectLvs",		(PyCFunction)liblvm_lvm_vg_select_lvs, METH_VARARGS },
+	{ "selectPvs",		(PyCFunction)liblvm_lvm_vg_select_pvs, METH_VARARGS },
+	{ "listMoves",		(PyCFunction)liblvm_lvm_vg_list_moves, METH_NOARGS },
+	{ "probePvs",		(PyCFunction)liblvm_lvm_vg_probe_pvs, METH_VARARGS | METH_KEYWORDS },
+	{ "ioStats",		(PyCFunction)liblvm_lvm_vg_io_stats, METH_VARARGS | METH_KEYWORDS },
 	{ NULL,	     NULL}   /* sentinel */
 };
 
@@ -1577,6 +9829,7 @@ static PyMethodDef liblvm_lv_methods[] = {
 	{ "deactivate",		(PyCFunction)liblvm_lvm_lv_deactivate, METH_NOARGS },
 	{ "remove",		(PyCFunction)liblvm_lvm_vg_remove_lv, METH_NOARGS },
 	{ "getProperty",	(PyCFunction)liblvm_lvm_lv_get_property, METH_VARARGS },
+	{ "attrs",		(PyCFunction)liblvm_lvm_lv_attrs, METH_NOARGS },
 	{ "getSize",		(PyCFunction)liblvm_lvm_lv_get_size, METH_NOARGS },
 	{ "isActive",		(PyCFunction)liblvm_lvm_lv_is_active, METH_NOARGS },
 	{ "isSuspended",	(PyCFunction)liblvm_lvm_lv_is_suspended, METH_NOARGS },
@@ -1587,7 +9840,11 @@ static PyMethodDef liblvm_lv_methods[] = {
 	{ "rename",		(PyCFunction)liblvm_lvm_lv_rename, METH_VARARGS },
 #endif
 	{ "resize",		(PyCFunction)liblvm_lvm_lv_resize, METH_VARARGS },
+	{ "snapshot",		(PyCFunction)liblvm_lvm_lv_snapshot, METH_VARARGS | METH_KEYWORDS },
+	{ "ioStats",		(PyCFunction)liblvm_lvm_lv_io_stats, METH_VARARGS | METH_KEYWORDS },
+	{ "ioStatsRemove",	(PyCFunction)liblvm_lvm_lv_io_stats_remove, METH_NOARGS },
 	{ "listLVsegs",		(PyCFunction)liblvm_lvm_lv_list_lvsegs, METH_NOARGS },
+	{ "segmentTable",	(PyCFunction)liblvm_lvm_lv_seg_table, METH_NOARGS },
 	{ NULL,	     NULL}   /* sentinel */
 };
 
@@ -1597,11 +9854,14 @@ static PyMethodDef liblvm_pv_methods[] = {
 	{ "getUuid",		(PyCFunction)liblvm_lvm_pv_get_uuid, METH_NOARGS },
 	{ "getMdaCount",	(PyCFunction)liblvm_lvm_pv_get_mda_count, METH_NOARGS },
 	{ "getProperty",	(PyCFunction)liblvm_lvm_pv_get_property, METH_VARARGS },
+	{ "attrs",		(PyCFunction)liblvm_lvm_pv_attrs, METH_NOARGS },
 	{ "getSize",		(PyCFunction)liblvm_lvm_pv_get_size, METH_NOARGS },
 	{ "getDevSize",		(PyCFunction)liblvm_lvm_pv_get_dev_size, METH_NOARGS },
 	{ "getFree",		(PyCFunction)liblvm_lvm_pv_get_free, METH_NOARGS },
 	{ "resize",		(PyCFunction)liblvm_lvm_pv_resize, METH_VARARGS },
 	{ "listPVsegs", 	(PyCFunction)liblvm_lvm_pv_list_pvsegs, METH_NOARGS },
+	{ "probe",		(PyCFunction)liblvm_lvm_pv_probe, METH_VARARGS | METH_KEYWORDS },
+	{ "segmentTable",	(PyCFunction)liblvm_lvm_pv_seg_table, METH_NOARGS },
 	{ NULL,	     NULL}   /* sentinel */
 };
 
@@ -1615,6 +9875,40 @@ static PyMethodDef liblvm_pvseg_methods[] = {
 	{ NULL,	     NULL}   /* sentinel */
 };
 
+static PyMethodDef liblvm_watch_methods[] = {
+	{ "fileno",		(PyCFunction)liblvm_watch_fileno, METH_NOARGS },
+	{ "read",		(PyCFunction)liblvm_watch_read, METH_NOARGS },
+	{ "close",		(PyCFunction)liblvm_watch_close, METH_NOARGS },
+	{ NULL,	     NULL}   /* sentinel */
+};
+
+static PyMethodDef liblvm_invreader_methods[] = {
+	{ "refresh",		(PyCFunction)liblvm_invreader_refresh, METH_NOARGS },
+	{ "generation",		(PyCFunction)liblvm_invreader_generation, METH_NOARGS },
+	{ "listVgNames",	(PyCFunction)liblvm_invreader_list_vg_names, METH_NOARGS },
+	{ "getVg",		(PyCFunction)liblvm_invreader_get_vg, METH_VARARGS },
+	{ "listLvs",		(PyCFunction)liblvm_invreader_list_lvs, METH_VARARGS },
+	{ "listPvs",		(PyCFunction)liblvm_invreader_list_pvs, METH_VARARGS },
+	{ "close",		(PyCFunction)liblvm_invreader_close, METH_NOARGS },
+	{ NULL,	     NULL}   /* sentinel */
+};
+
+static PyMethodDef liblvm_broker_methods[] = {
+	{ "listVgNames",	(PyCFunction)liblvm_broker_list_vg_names, METH_NOARGS },
+	{ "getVg",		(PyCFunction)liblvm_broker_get_vg, METH_VARARGS },
+	{ "listLvs",		(PyCFunction)liblvm_broker_list_lvs, METH_VARARGS },
+	{ "listPvs",		(PyCFunction)liblvm_broker_list_pvs, METH_VARARGS },
+	{ "close",		(PyCFunction)liblvm_broker_close, METH_NOARGS },
+	{ NULL,	     NULL}   /* sentinel */
+};
+
+static PyMethodDef liblvm_move_methods[] = {
+	{ "getName",		(PyCFunction)liblvm_move_get_name, METH_NOARGS },
+	{ "progress",		(PyCFunction)liblvm_move_progress, METH_NOARGS },
+	{ "wait",		(PyCFunction)liblvm_move_wait, METH_VARARGS | METH_KEYWORDS },
+	{ NULL,	     NULL}   /* sentinel */
+};
+
 static PyTypeObject LibLVMvgType = {
 	PyObject_HEAD_INIT(&PyType_Type)
 	.tp_name = "liblvm.Liblvm_vg",
@@ -1670,11 +9964,89 @@ static PyTypeObject LibLVMpvsegType = {
 	.tp_methods = liblvm_pvseg_methods,
 };
 
+static PySequenceMethods liblvm_segtable_as_sequence = {
+	.sq_length = (lenfunc)liblvm_segtable_length,
+};
+
+static PyBufferProcs liblvm_segtable_as_buffer = {
+	.bf_getbuffer = (getbufferproc)liblvm_segtable_getbuffer,
+};
+
+static PyTypeObject LibLVMsegtableType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_segtable",
+	.tp_basicsize = sizeof(segtableobject),
+	.tp_dealloc = (destructor)liblvm_segtable_dealloc,
+	.tp_as_sequence = &liblvm_segtable_as_sequence,
+	.tp_as_buffer = &liblvm_segtable_as_buffer,
+	.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+	.tp_doc = "LVM segment table, packed records readable through the buffer protocol",
+};
+
+static PySequenceMethods liblvm_inventory_as_sequence = {
+	.sq_length = (lenfunc)liblvm_inventory_length,
+};
+
+static PyTypeObject LibLVMinventoryType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_inventory",
+	.tp_basicsize = sizeof(inventoryobject),
+	.tp_dealloc = (destructor)liblvm_inventory_dealloc,
+	.tp_as_sequence = &liblvm_inventory_as_sequence,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "LVM inventory snapshot, see lvm.diff()",
+};
+
+static PyTypeObject LibLVMwatchType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_watch",
+	.tp_basicsize = sizeof(watchobject),
+	.tp_dealloc = (destructor)liblvm_watch_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "LVM change notification, pollable through fileno()",
+	.tp_methods = liblvm_watch_methods,
+};
+
+static PyTypeObject LibLVMinvreaderType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_invreader",
+	.tp_basicsize = sizeof(invreaderobject),
+	.tp_dealloc = (destructor)liblvm_invreader_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Published LVM inventory, mapped read-only",
+	.tp_methods = liblvm_invreader_methods,
+};
+
+static PyTypeObject LibLVMbrokerType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_broker",
+	.tp_basicsize = sizeof(brokerobject),
+	.tp_dealloc = (destructor)liblvm_broker_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Connection to an LVM query broker",
+	.tp_methods = liblvm_broker_methods,
+};
+
+static PyTypeObject LibLVMmoveType = {
+	PyObject_HEAD_INIT(&PyType_Type)
+	.tp_name = "liblvm.Liblvm_move",
+	.tp_basicsize = sizeof(moveobject),
+	.tp_dealloc = (destructor)liblvm_move_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Extent move in progress",
+	.tp_methods = liblvm_move_methods,
+};
+
 static void
 liblvm_cleanup(void)
 {
-	lvm_quit(libh);
+	PyThread_acquire_lock(liblvm_lock, WAIT_LOCK);
+	liblvm_side_retire();
+	if (libh)
+		lvm_quit(libh);
 	libh = NULL;
+	liblvm_exiting = 1;
+	PyThread_release_lock(liblvm_lock);
 }
 
 PyMODINIT_FUNC
@@ -1682,7 +10054,8 @@ initlvm(void)
 {
 	PyObject *m;
 
-	libh = lvm_init(NULL);
+	if ((liblvm_lock = PyThread_allocate_lock()) == NULL)
+		return;
 
 	if (PyType_Ready(&LibLVMvgType) < 0)
 		return;
@@ -1694,6 +10067,22 @@ initlvm(void)
 		return;
 	if (PyType_Ready(&LibLVMpvsegType) < 0)
 		return;
+	if (PyType_Ready(&LibLVMsegtableType) < 0)
+		return;
+	if (PyType_Ready(&LibLVMinventoryType) < 0)
+		return;
+	if (PyType_Ready(&LibLVMwatchType) < 0)
+		return;
+	if (PyType_Ready(&LibLVMinvreaderType) < 0)
+		return;
+	if (PyType_Ready(&LibLVMbrokerType) < 0)
+		return;
+	if (PyType_Ready(&LibLVMmoveType) < 0)
+		return;
+
+	PyStructSequence_InitType(&LibLVMlvattrsType, &lvattrs_desc);
+	PyStructSequence_InitType(&LibLVMpvattrsType, &pvattrs_desc);
+	PyStructSequence_InitType(&LibLVMvgattrsType, &vgattrs_desc);
 
 	m = Py_InitModule3("lvm", Liblvm_methods, "Liblvm module");
 	if (m == NULL)
@@ -1709,5 +10098,19 @@ initlvm(void)
 		PyModule_AddObject(m, "LibLVMError", LibLVMError);
 	}
 
+	LibLVMLockBusy = PyErr_NewException("Liblvm.LockBusy",
+					    LibLVMError, NULL);
+	if (LibLVMLockBusy) {
+		Py_INCREF(LibLVMLockBusy);
+		PyModule_AddObject(m, "LockBusy", LibLVMLockBusy);
+	}
+
+	Py_INCREF(&LibLVMlvattrsType);
+	PyModule_AddObject(m, "LvAttrs", (PyObject *)&LibLVMlvattrsType);
+	Py_INCREF(&LibLVMpvattrsType);
+	PyModule_AddObject(m, "PvAttrs", (PyObject *)&LibLVMpvattrsType);
+	Py_INCREF(&LibLVMvgattrsType);
+	PyModule_AddObject(m, "VgAttrs", (PyObject *)&LibLVMvgattrsType);
+
 	Py_AtExit(liblvm_cleanup);
 }
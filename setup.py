@@ -2,7 +2,7 @@ from distutils.core import setup, Extension
 
 liblvm = Extension('lvm',
                     sources = ['liblvm.c'],
-                    libraries= ['lvm2app'])
+                    libraries= ['lvm2app', 'devmapper'])
 
 setup (name = 'lvm',
        version = '1.2.3',
@@ -0,0 +1,111 @@
+#
+# Copyright (C) 2012 Red Hat, Inc. All rights reserved.
+#
+# This file is part of LVM2.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#-----------------------------
+# Python multi-threaded stress test (manual):
+#-----------------------------
+#
+# Usage: python stress.py [threads] [iterations]
+#
+# This is not an automated test.  It needs root and real volume groups, and
+# is meant to be run by hand on a test box.
+#
+# Every thread keeps opening, reading and closing all volume groups, mixing
+# plain, lockless and timed opens, while listing names and uuids in between.
+# Only read-only opens are used.  lvm calls from the threads still take turns
+# on the library lock; what this exercises is the locking itself.
+
+import sys
+import threading
+import traceback
+
+import lvm
+
+#Opens that take turns; (mode, keyword arguments)
+OPEN_KINDS = [
+    ('r', {}),
+    ('r', {'nolock': True}),
+    ('r', {'timeout': 5.0}),
+]
+
+failures = []
+failures_lock = threading.Lock()
+
+#Touch everything a monitoring loop would read
+def read_vg(vg):
+    vg.getName()
+    vg.getUuid()
+    vg.getSize()
+    vg.getFreeSize()
+    vg.getTags()
+
+    for p in vg.listPVs():
+        p.getName()
+        p.getUuid()
+        p.getSize()
+
+    for l in vg.listLVs():
+        l.getName()
+        l.getUuid()
+        l.getSize()
+        l.attrs()
+        l.isActive()
+        l.getTags()
+
+def worker(index, iterations):
+    for i in range(iterations):
+        mode, kwargs = OPEN_KINDS[(index + i) % len(OPEN_KINDS)]
+        try:
+            lvm.listVgUuids()
+            for vg_name in lvm.listVgNames():
+                try:
+                    vg = lvm.vgOpen(vg_name, mode, **kwargs)
+                except lvm.LockBusy:
+                    #A writer elsewhere outlasted the timeout
+                    continue
+                try:
+                    read_vg(vg)
+                finally:
+                    vg.close()
+        except Exception:
+            with failures_lock:
+                failures.append((index, i, traceback.format_exc()))
+            return
+
+if __name__ == '__main__':
+    threads = int(sys.argv[1]) if len(sys.argv) > 1 else 8
+    iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 50
+
+    print 'lvm version=', lvm.getVersion()
+    print 'Running', threads, 'threads x', iterations, 'iterations over', \
+        len(lvm.listVgNames()), 'volume groups'
+
+    pool = [threading.Thread(target=worker, args=(t, iterations))
+            for t in range(threads)]
+    for t in pool:
+        t.start()
+    for t in pool:
+        t.join()
+
+    for index, i, tb in failures:
+        print 'Thread', index, 'failed at iteration', i
+        print tb
+
+    if failures:
+        sys.exit(1)
+    print 'OK'
@@ -0,0 +1,89 @@
+#
+# Copyright (C) 2012 Red Hat, Inc. All rights reserved.
+#
+# This file is part of LVM2.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#-----------------------------
+# Timed and non-blocking vgOpen() against a VG locked by another process:
+#-----------------------------
+#
+# Usage: python test_lockbusy.py
+#
+# Needs root and at least one volume group; the test is skipped otherwise.
+# A second process opens the first VG for writing, which holds its lock
+# until that process is told to let go.  Nothing is written to the VG.
+
+import os
+import subprocess
+import sys
+import time
+import unittest
+
+import lvm
+
+HOLDER = '''
+import sys
+import lvm
+vg = lvm.vgOpen(sys.argv[1], 'w')
+sys.stdout.write('locked\\n')
+sys.stdout.flush()
+sys.stdin.read()
+vg.close()
+'''
+
+def first_vg():
+    if os.geteuid() != 0:
+        return None
+    names = lvm.listVgNames()
+    return names[0] if names else None
+
+VG_NAME = first_vg()
+
+@unittest.skipIf(VG_NAME is None, 'needs root and a volume group')
+class LockBusyTest(unittest.TestCase):
+
+    def setUp(self):
+        self.holder = subprocess.Popen([sys.executable, '-c', HOLDER, VG_NAME],
+                                       stdin=subprocess.PIPE,
+                                       stdout=subprocess.PIPE)
+        self.assertEqual(self.holder.stdout.readline().strip(), 'locked')
+
+    def tearDown(self):
+        self.holder.stdin.close()
+        self.holder.wait()
+
+    def busy_count(self):
+        stats = lvm.lockStats().get(VG_NAME)
+        return stats[7] if stats else 0
+
+    def test_nowait(self):
+        busy = self.busy_count()
+        self.assertRaises(lvm.LockBusy, lvm.vgOpen, VG_NAME, 'r', nowait=True)
+        self.assertEqual(self.busy_count(), busy + 1)
+
+    def test_timeout(self):
+        start = time.time()
+        self.assertRaises(lvm.LockBusy, lvm.vgOpen, VG_NAME, 'r', timeout=0.5)
+        self.assertTrue(time.time() - start >= 0.4)
+
+    def test_released(self):
+        self.holder.stdin.close()
+        self.holder.wait()
+        vg = lvm.vgOpen(VG_NAME, 'r', timeout=5.0)
+        vg.close()
+
+if __name__ == '__main__':
+    unittest.main()